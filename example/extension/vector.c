@@ -0,0 +1,125 @@
+/* A sample native extension, build it with make and load it with
+ *
+ *     use native "libvector.so";
+ *     vector.Dot([1, 2], [3, 4]);
+ *
+ * Everything the vm does for the extension goes through api */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/extension.h"
+
+static const ExtensionApi* api;
+
+/* Check for a list that only holds numbers */
+static bool isNumberList(Value value)
+{
+  if (!IS_LIST(value)) return false;
+
+  ObjList* list = AS_LIST(value);
+  for (int i = 0; i < list->count; i++)
+  {
+    if (!IS_NUMBER(indexFromList(list, i))) return false;
+  }
+  return true;
+}
+
+/* vector.Dot(a, b) */
+static Value dotNative(int argCount, Value* args)
+{
+  if (argCount != 2 || !isNumberList(args[0]) || !isNumberList(args[1]))
+  {
+    api->runtimeError("vector.Dot() takes two lists of numbers.");
+    return NIL_VAL;
+  }
+
+  ObjList* a = AS_LIST(args[0]);
+  ObjList* b = AS_LIST(args[1]);
+  if (a->count != b->count)
+  {
+    api->runtimeError("vector.Dot() needs lists of the same length.");
+    return NIL_VAL;
+  }
+
+  double sum = 0;
+  for (int i = 0; i < a->count; i++)
+    sum += AS_NUMBER(indexFromList(a, i)) * AS_NUMBER(indexFromList(b, i));
+  return NUMBER_VAL(sum);
+}
+
+/* vector.Norm(list) */
+static Value normNative(int argCount, Value* args)
+{
+  if (argCount != 1 || !isNumberList(args[0]))
+  {
+    api->runtimeError("vector.Norm() takes a list of numbers.");
+    return NIL_VAL;
+  }
+
+  return NUMBER_VAL(sqrt(AS_NUMBER(dotNative(2, (Value[]){ args[0], args[0] }))));
+}
+
+/* vector.Scale(list, k) returns a new list */
+static Value scaleNative(int argCount, Value* args)
+{
+  if (argCount != 2 || !isNumberList(args[0]) || !IS_NUMBER(args[1]))
+  {
+    api->runtimeError("vector.Scale() takes a list of numbers and a number.");
+    return NIL_VAL;
+  }
+
+  ObjList* list = AS_LIST(args[0]);
+  ObjList* scaled = api->newList();
+  for (int i = 0; i < list->count; i++)
+  {
+    double item = AS_NUMBER(indexFromList(list, i));
+    api->appendToList(scaled, NUMBER_VAL(item * AS_NUMBER(args[1])));
+  }
+  return OBJ_VAL(scaled);
+}
+
+/* vector.Hypot(x, y), called straight from the vm when given numbers */
+static Value hypotNative(int argCount, Value* args)
+{
+  if (argCount != 2 || !IS_NUMBER(args[0]) || !IS_NUMBER(args[1]))
+  {
+    api->runtimeError("vector.Hypot() takes two numbers.");
+    return NIL_VAL;
+  }
+
+  return NUMBER_VAL(hypot(AS_NUMBER(args[0]), AS_NUMBER(args[1])));
+}
+
+/* vector.Label(name, n) gives "name[n]" */
+static Value labelNative(int argCount, Value* args)
+{
+  ObjString* name = argCount == 2 ? api->toString(args[0]) : NULL;
+  if (name == NULL || !IS_NUMBER(args[1]))
+  {
+    api->runtimeError("vector.Label() takes a string and a number.");
+    return NIL_VAL;
+  }
+
+  char* label = malloc(name->length + 32);
+  int length = sprintf(label, "%s[%d]", name->chars, (int)AS_NUMBER(args[1]));
+  ObjString* result = api->copyString(label, length);
+  free(label);
+  return OBJ_VAL(result);
+}
+
+bool MT_EXTENSION_INIT(const ExtensionApi* vmApi)
+{
+  if (vmApi->version < MT_EXTENSION_VERSION) return false;
+  api = vmApi;
+
+  ObjNativeClass* vector = api->defineModule("vector");
+  api->defineModuleMethod(vector, "Dot", dotNative);
+  api->defineModuleMethod(vector, "Norm", normNative);
+  api->defineModuleMethod(vector, "Scale", scaleNative);
+  api->defineBinaryModuleMethod(vector, "Hypot", hypotNative, hypot);
+  api->defineModuleMethod(vector, "Label", labelNative);
+  return true;
+}
@@ -9,6 +9,7 @@ typedef enum
 {
     OP_ADD,      // +
     OP_BUILD_LIST, // []
+    OP_BUILD_MAP, // {k: v}
     OP_BUILD_TUPLE, // ()
     OP_CALL,
     OP_CLASS,
@@ -22,6 +23,8 @@ typedef enum
     OP_EQUAL,
     OP_FALSE,
     OP_FOR_ITERATOR,
+    OP_FOR_LOOP,  // counted loop step and branch
+    OP_FOR_PREP,  // counted loop entry check
     OP_GENERATE_LIST,
     OP_GET_GLOBAL,
     OP_GET_LOCAL,// get value of local varible
@@ -30,15 +33,26 @@ typedef enum
     OP_GET_UPVALUE,
     OP_GREATER,
     OP_IMPORT,
+    OP_IN,       // x in container
     OP_ITERATOR,
     OP_INCR,     // ++
     OP_INDEX_SUBSCR, // [n]
     OP_INHERIT,
     OP_INVOKE,
+    OP_INVOKE_NATIVE, // resolved module method call
     OP_JUMP,
     OP_JUMP_IF_FALSE,
+    OP_JUMP_IF_GREATER,     // fused a <= b branch
+    OP_JUMP_IF_LESS,        // fused a >= b branch
+    OP_JUMP_IF_NOT_GREATER, // fused a > b branch
+    OP_JUMP_IF_NOT_LESS,    // fused a < b branch
     OP_LESS,
     OP_LOOP,
+    OP_MATH_ABS,  // math.Abs(x) intrinsic
+    OP_MATH_COS,  // math.Cos(x) intrinsic
+    OP_MATH_POW,  // math.Pow(x, y) intrinsic
+    OP_MATH_SIN,  // math.Sin(x) intrinsic
+    OP_MATH_SQRT, // math.Sqrt(x) intrinsic
     OP_METHOD,
     OP_MOD,      // %
     OP_MULTIPLY, // *
@@ -62,8 +76,19 @@ typedef enum
     OP_TYPE_SET,
     OP_USE,
     OP_USE_ALL,
+    OP_USE_NATIVE, // use native "lib.so"
 } OpCode;
 
+/* Flags operand for OP_FOR_PREP and OP_FOR_LOOP, the low two bits
+ * select the comparison used against the loop limit */
+#define FOR_CMP_LESS          0x00
+#define FOR_CMP_LESS_EQUAL    0x01
+#define FOR_CMP_GREATER       0x02
+#define FOR_CMP_GREATER_EQUAL 0x03
+#define FOR_CMP_MASK          0x03
+#define FOR_LIMIT_CONSTANT    0x04 // limit is a constant not a local slot
+#define FOR_STEP_SUBTRACT     0x08 // loop variable is decremented by step
+
 /* Byte code chunk definition: wrapper for dynamic array */
 typedef struct
 {
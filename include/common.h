@@ -7,6 +7,7 @@
 
 //#define MT_DEBUG_PRINT_CODE // print return chunks
 //#define MT_DEBUG_TRACE_EXEC // if on will print stuff for 'pro' users
+//#define MT_DEBUG_PRINT_ALLOC // print allocator counters when the vm exits
 
 // #define MT_OUT_STREAM
 
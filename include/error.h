@@ -36,6 +36,7 @@ typedef enum {
     E_COMPILER_LIST_TOO_LARGE           = 217,
     E_COMPILER_TOO_MANY_LOCALS          = 218,
     E_COMPILER_TOO_MANY_CLOSURES        = 219,
+    E_COMPILER_MAP_TOO_LARGE            = 220,
 
     // 221-230: Class/OOP-Related Errors (Property/Super)
     E_COMPILER_EXPECTED_PROPERTY_NAME   = 221,
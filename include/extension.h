@@ -0,0 +1,48 @@
+#ifndef mt_extension_h
+#define mt_extension_h
+
+#include "object.h"
+
+/* Native modules in shared libraries, loaded with use native "lib.so".
+ * An extension defines MT_EXTENSION_INIT, which is handed the functions
+ * below to add its modules with. The mt binary does not export its own
+ * symbols, so extensions only call into the vm through this table */
+
+#define MT_EXTENSION_VERSION 1
+
+/* The entry point carries the version of the api it was built against,
+ * so a library built for another version is not found */
+#define MT_EXTENSION_INIT mtExtensionInit1
+#define MT_EXTENSION_INIT_NAME "mtExtensionInit1"
+
+typedef struct
+{
+  int version;   // MT_EXTENSION_VERSION of the vm
+
+  /* Modules, defining one again replaces it */
+  ObjNativeClass* (*defineModule)(const char* name);
+  void (*defineModuleMethod)(ObjNativeClass* klass, const char* name,
+                             NativeFn function);
+  void (*defineUnaryModuleMethod)(ObjNativeClass* klass, const char* name,
+                                  NativeFn function, UnaryNumberFn unary);
+  void (*defineBinaryModuleMethod)(ObjNativeClass* klass, const char* name,
+                                   NativeFn function, BinaryNumberFn binary);
+
+  /* A native that calls runtimeError should return straight away */
+  void (*runtimeError)(const char* format, ...);
+
+  /* Values */
+  ObjString* (*copyString)(const char* chars, int length);
+  ObjString* (*toString)(Value value);   // NULL if value is not a string
+  ObjList* (*newList)(void);
+  void (*appendToList)(ObjList* list, Value value);
+  bool (*vmCall)(Value callee, Value* args, int argCount, Value* result);
+} ExtensionApi;
+
+/* Returns false if the extension could not set itself up */
+typedef bool (*ExtensionInit)(const ExtensionApi* api);
+
+bool loadExtension(const char* path);
+bool extensionsLoaded();
+
+#endif
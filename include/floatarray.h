@@ -0,0 +1,42 @@
+#ifndef mt_floatarray_h
+#define mt_floatarray_h
+
+#include <math.h>
+
+#include "common.h"
+
+/* Element-wise kernels for Float64 arrays. They use AVX when the cpu has
+ * it, SSE2 on other x86-64 machines and plain loops everywhere else */
+
+typedef enum
+{
+	FLOAT_ADD,
+	FLOAT_SUBTRACT,
+	FLOAT_MULTIPLY,
+	FLOAT_DIVIDE,
+	FLOAT_POW,
+} FloatOp;
+
+/* a op b for one pair of numbers */
+static inline double applyFloatOp(FloatOp op, double a, double b)
+{
+	switch (op)
+	{
+	case FLOAT_ADD:      return a + b;
+	case FLOAT_SUBTRACT: return a - b;
+	case FLOAT_MULTIPLY: return a * b;
+	case FLOAT_DIVIDE:   return a / b;
+	case FLOAT_POW:      return pow(a, b);
+	}
+	return 0; // unreachable
+}
+
+/* dest[i] = a[i] op b[i] */
+void floatArrayOp(FloatOp op, double* dest, const double* a, const double* b,
+                  int count);
+
+/* dest[i] = a[i] op scalar, or scalar op a[i] when scalarFirst is set */
+void floatScalarOp(FloatOp op, double* dest, const double* a, double scalar,
+                   bool scalarFirst, int count);
+
+#endif
@@ -10,6 +10,7 @@ typedef struct
 {
   ObjList* list;
   int iter;
+  ObjStream* stream;   // set when walking a stream instead of a list
 } ObjectIterator;
 
 ObjectIterator* newIterator();
@@ -0,0 +1,21 @@
+#ifndef mt_map_h
+#define mt_map_h
+
+#include "object.h"
+
+/* Native hash maps, keys can be numbers, strings, bools, nil or tuples
+ * made of those */
+
+ObjMap* newMap();
+void freeMap(ObjMap* map);
+bool isHashable(Value value);
+uint32_t hashValue(Value value);
+bool mapGet(ObjMap* map, Value key, Value* value);
+bool mapSet(ObjMap* map, Value key, Value value);
+bool mapDelete(ObjMap* map, Value key);
+void mapReserve(ObjMap* map, int count);
+ObjList* mapKeys(ObjMap* map);
+void printMap(ObjMap* map);
+void printSet(ObjSet* set);
+
+#endif
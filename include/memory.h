@@ -11,6 +11,10 @@
 
 #define FREE(type, pointer) reallocate(pointer, sizeof(type), 0)
 
+/* Free an object that ends in a flexible array of count items */
+#define FREE_FLEX(type, itemType, pointer, count) \
+    reallocate(pointer, sizeof(type) + sizeof(itemType) * (count), 0)
+
 /* Calculate the new capacity based on the current capacity using
 new = old * 2 */
 #define GROW_CAPACITY(capacity) \
@@ -26,8 +30,21 @@ new = old * 2 */
 #define FREE_ARRAY(type, pointer, oldCount) \
     reallocate(pointer, sizeof(type) * (oldCount), 0)
 
+/* Counters kept by the size class allocator */
+typedef struct {
+  size_t bytesAllocated;   // bytes currently held through reallocate
+  size_t smallAllocations; // blocks handed out from a size class
+  size_t freeListReuses;   // of those, how many came off a free list
+  size_t largeAllocations; // blocks passed through to malloc
+  size_t pagesAllocated;   // pages small blocks are carved from
+} AllocStats;
+
+extern AllocStats allocStats;
+
 /* Plysically reallocate the memory */
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
 void freeObjects();
+void freePages();
+void printAllocStats();
 
 #endif
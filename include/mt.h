@@ -0,0 +1,86 @@
+#ifndef mt_h
+#define mt_h
+
+/* Running mt inside a C or C++ program, link with libmt.a or libmt.so.
+ *
+ *   MtVM* vm = mtNewVM(NULL);
+ *   MtScript* script = mtCompile(vm, "fn add(a, b) { return a + b; }", "add");
+ *   mtRun(vm, script);
+ *
+ *   mtPush(vm, mtNumber(1));
+ *   mtPush(vm, mtNumber(2));
+ *   if (mtCall(vm, "add", 2) == MT_OK) printf("%g\n", mtAsNumber(mtPop(vm)));
+ *
+ *   mtFreeVM(vm);
+ *
+ * The vm is shared by the whole process, so there is one at a time and
+ * mtNewVM returns NULL while another one exists */
+
+#include "value.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MtVM MtVM;
+typedef struct MtScript MtScript;
+typedef Value MtValue;
+
+typedef enum
+{
+  MT_OK,
+  MT_COMPILE_ERROR,
+  MT_RUNTIME_ERROR,
+} MtResult;
+
+/* Receives text the vm prints, it is not NUL terminated */
+typedef void (*MtWriteFn)(const char* text, size_t length, void* data);
+
+/* Host functions are called the same way as the vm's own natives. One
+ * that fails calls mtError and returns straight away */
+typedef MtValue (*MtNativeFn)(int argCount, MtValue* args);
+
+typedef struct
+{
+  MtWriteFn output;  // print and the printing natives, stdout when NULL
+  MtWriteFn error;   // compile and runtime errors, stderr when NULL
+  void* data;        // passed to both
+} MtConfig;
+
+/* Lifecycle, config may be NULL */
+MtVM* mtNewVM(const MtConfig* config);
+void mtFreeVM(MtVM* vm);
+
+/* Compile once and run as many times as needed. Scripts live until the
+ * vm is freed, name is used in error messages and for use paths */
+MtScript* mtCompile(MtVM* vm, const char* source, const char* name);
+MtResult mtRun(MtVM* vm, MtScript* script);
+
+/* Call the global function name with the top argCount values on the
+ * stack, which are replaced with what it returns */
+MtResult mtCall(MtVM* vm, const char* name, int argCount);
+void mtPush(MtVM* vm, MtValue value);
+MtValue mtPop(MtVM* vm);
+
+/* Host natives and globals */
+void mtDefineNative(MtVM* vm, const char* name, MtNativeFn function);
+void mtSetGlobal(MtVM* vm, const char* name, MtValue value);
+bool mtGetGlobal(MtVM* vm, const char* name, MtValue* value);
+void mtError(const char* format, ...);
+
+/* Values */
+MtValue mtNil(void);
+MtValue mtBool(bool boolean);
+MtValue mtNumber(double number);
+MtValue mtString(MtVM* vm, const char* chars, int length);
+bool mtIsNumber(MtValue value);
+bool mtIsString(MtValue value);
+double mtAsNumber(MtValue value);      // 0 if value is not a number
+bool mtAsBool(MtValue value);          // false only for nil and false
+const char* mtAsString(MtValue value, int* length);  // NULL if not a string
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,11 +15,16 @@
 #define IS_NATIVE_CLASS(value) isObjType(value, OBJ_NATIVE_CLASS)
 #define IS_CLOSURE(value)  isObjType(value, OBJ_CLOSURE)
 #define IS_STRING(value)   isObjType(value, OBJ_STRING)
+#define IS_ROPE(value)     isObjType(value, OBJ_ROPE)
 #define IS_FUNCTION(value) isObjType(value, OBJ_FUNCTION)
 #define IS_INSTANCE(value) isObjType(value, OBJ_INSTANCE)
 #define IS_NATIVE(value)   isObjType(value, OBJ_NATIVE)
 #define IS_LIST(value)     isObjType(value, OBJ_LIST)
 #define IS_TUPLE(value)     isObjType(value, OBJ_TUPLE)
+#define IS_FLOAT_ARRAY(value) isObjType(value, OBJ_FLOAT_ARRAY)
+#define IS_MAP(value)      isObjType(value, OBJ_MAP)
+#define IS_SET(value)      isObjType(value, OBJ_SET)
+#define IS_STREAM(value)   isObjType(value, OBJ_STREAM)
 #define IS_MODULE(value)   isObjType(value, OBJ_VALUE)
 
 #define AS_BOUND_METHOD(value)  ((ObjBoundMethod*)AS_OBJ(value))
@@ -29,10 +34,16 @@
 #define AS_FUNCTION(value)      ((ObjFunction*)AS_OBJ(value))
 #define AS_INSTANCE(value)      ((ObjInstance*)AS_OBJ(value))
 #define AS_NATIVE(value)        (((ObjNative*)AS_OBJ(value))->function)
+#define AS_NATIVE_OBJ(value)    ((ObjNative*)AS_OBJ(value))
 #define AS_STRING(value)        ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)       (((ObjString*)AS_OBJ(value))->chars)
+#define AS_ROPE(value)          ((ObjRope*)AS_OBJ(value))
 #define AS_LIST(value)          ((ObjList*)AS_OBJ(value))
 #define AS_TUPLE(value)          ((ObjTuple*)AS_OBJ(value))
+#define AS_FLOAT_ARRAY(value)   ((ObjFloatArray*)AS_OBJ(value))
+#define AS_MAP(value)           ((ObjMap*)AS_OBJ(value))
+#define AS_SET(value)           ((ObjSet*)AS_OBJ(value))
+#define AS_STREAM(value)        ((ObjStream*)AS_OBJ(value))
 #define AS_MODULE(value)        ((ObjectModule*)AS_OBJ(value))
 
 typedef enum
@@ -45,8 +56,13 @@ typedef enum
     OBJ_INSTANCE,
     OBJ_NATIVE,
     OBJ_STRING,
+    OBJ_ROPE,
     OBJ_LIST,
     OBJ_TUPLE,
+    OBJ_FLOAT_ARRAY,
+    OBJ_MAP,
+    OBJ_SET,
+    OBJ_STREAM,
     OBJ_UPVALUE,
     OBJ_MODULE,
     OBJ_ITERATOR,
@@ -70,29 +86,67 @@ typedef struct
 /* Shorthand */
 typedef Value (*NativeFn)(int argCount, Value* args);
 
+/* Plain C functions on numbers a native can also be registered with */
+typedef double (*UnaryNumberFn)(double);
+typedef double (*BinaryNumberFn)(double, double);
+
 /*Native objects */
 typedef struct 
 {
     Obj obj;
     NativeFn function;
+    ObjString* module;   // the module and method names of module methods,
+    ObjString* name;     // used when a resolved call has to look them up
+    /* called straight away when given exactly this many numbers, 0 if
+     * the native only has the generic function */
+    int numberArity;
+    union {
+        UnaryNumberFn unary;
+        BinaryNumberFn binary;
+    };
 } ObjNative;
 
-/* Create a native class for the module system */
-typedef struct sObjNativeClass {
+/* Create a native class for the module system. Built-in modules start
+ * with no methods and a loader that adds them when first needed */
+typedef struct sObjNativeClass ObjNativeClass;
+typedef void (*ModuleLoader)(ObjNativeClass* klass);
+
+struct sObjNativeClass {
   Obj obj;
   ObjString* name;
   Table methods;
-} ObjNativeClass;
+  ModuleLoader load;   // NULL once the methods are there
+};
+
+/* Create strings that are fast, the characters live in the same
+ * allocation as the header */
+/* Strings of at least this many chars are not hashed or interned until
+ * they are used as a table key */
+#define LAZY_INTERN_LENGTH 1024
 
-/* Create strings that are fast */
 struct sObjString
 {
 	Obj obj;
 	int length;
-	char * chars;
 	uint32_t hash;
+	bool interned; // false for long strings until internedString is called
+	bool module;   // the name of a built-in module
+	char chars[];
 };
 
+/* The result of joining two strings with +, or a slice of one string.
+ * The characters are only copied out into a string when something needs
+ * to look at them */
+typedef struct
+{
+	Obj obj;
+	int length;
+	Obj* left;       // ObjString or ObjRope, the sliced string for a slice
+	Obj* right;      // ObjString or ObjRope, NULL for a slice
+	int offset;      // where a slice starts in left
+	ObjString* flat; // set once the rope has been flattened
+} ObjRope;
+
 /* Used for detecting scope as a runtime object */
 typedef struct ObjUpvalue
 {
@@ -107,8 +161,8 @@ typedef struct
 {
     Obj obj;
     ObjFunction* function;
-    ObjUpvalue** upvalues;
     int upvalueCount;
+    ObjUpvalue* upvalues[];
 } ObjClosure;
 
 /* CLasses finally */
@@ -136,24 +190,107 @@ typedef struct
   ObjClosure* method;
 } ObjBoundMethod;
 
+/* How a list stores its items. Lists start out as unboxed doubles and
+ * switch to full values the first time anything else is stored. Views
+ * read through to another list until either of them is written to */
+typedef enum
+{
+    LIST_NUMBERS,
+    LIST_VALUES,
+    LIST_VIEW,
+} ListStrategy;
+
 /* Adding lists to mt */
-typedef struct 
+typedef struct sObjList ObjList;
+
+struct sObjList
 {
     Obj obj;
     int count;
-    int capacity;
-    Value* items;
-} ObjList;
+    int capacity;          // slots from the first item to the end
+    int head;              // free slots before the first item
+    ListStrategy strategy;
+    union
+    {
+        double* numbers;   // LIST_NUMBERS
+        Value* items;      // LIST_VALUES
+        ObjList* parent;   // LIST_VIEW, never a view itself
+    };
+    int offset;            // LIST_VIEW: first index in the parent
+    int stride;            // LIST_VIEW: step through the parent
+    ObjList* views;        // views reading this list
+    ObjList* nextView;     // next view of the same parent
+};
 
-/* Immutable, ordered lists */
+/* Immutable, ordered lists, allocated once at their final size */
 typedef struct 
 {
   Obj obj;
   int count;
-  int capacity;
-  Value* items;
+  uint32_t hash;   // 0 until the tuple is first used as a key
+  Value items[];
 } ObjTuple;
 
+/* Fixed size arrays of unboxed doubles, arithmetic on them runs a whole
+ * array at a time */
+typedef struct
+{
+  Obj obj;
+  int count;
+  double items[];
+} ObjFloatArray;
+
+typedef struct
+{
+  Value key;
+  Value value;
+} MapEntry;
+
+/* Dictionaries with any hashable value as a key, laid out in groups of
+ * control bytes like Table */
+typedef struct
+{
+  Obj obj;
+  int count;        // live entries
+  int tombstones;
+  int capacity;     // number of slots - 1
+  MapEntry* entries;
+  uint8_t* control;
+} ObjMap;
+
+/* Sets share the map's storage, only the keys are used */
+typedef ObjMap ObjSet;
+
+typedef enum
+{
+    STREAM_LIST,
+    STREAM_FLOAT_ARRAY,
+    STREAM_RANGE,
+    STREAM_MAP,
+    STREAM_FILTER,
+    STREAM_TAKE,
+    STREAM_SKIP,
+    STREAM_CHUNK,
+} StreamStage;
+
+/* One stage of a lazy pipeline. Items are pulled through every stage
+ * at once, so nothing is stored between them */
+typedef struct ObjStream
+{
+  Obj obj;
+  StreamStage stage;
+  bool used;                    // streams feed one stage, once
+  union {
+    ObjList* list;              // STREAM_LIST
+    ObjFloatArray* array;       // STREAM_FLOAT_ARRAY
+    struct ObjStream* source;   // every other stage but STREAM_RANGE
+  };
+  Value fn;                     // STREAM_MAP, STREAM_FILTER
+  double next, end, step;       // STREAM_RANGE
+  int position;                 // items read, taken or skipped so far
+  int limit;                    // STREAM_TAKE, STREAM_SKIP, STREAM_CHUNK
+} ObjStream;
+
 /* Used for importing code */
 typedef struct 
 {
@@ -164,13 +301,21 @@ typedef struct
 } ObjectModule;
 
 ObjList* newList();
-ObjTuple* newTuple();
+ObjMap* newMap();
+ObjSet* newSet();
+ObjTuple* newTuple(int count);
+ObjFloatArray* newFloatArray(int count);
+ObjStream* newStream(StreamStage stage);
+ObjList* floatArrayToList(ObjFloatArray* array);
 void appendToList(ObjList* list, Value value);
-void appendToTuple(ObjTuple* tuple, Value value);
 void storeToList(ObjList* list, int index, Value value);
-Value indexFromList(ObjList* list, int index);
 Value indexFromTuple(ObjTuple* tuple, int index);
+void prependToList(ObjList* list, Value value);
 void deleteFromList(ObjList* list, int index);
+void generaliseList(ObjList* list);
+bool specialiseList(ObjList* list);
+ObjList* newListView(ObjList* list, int start, int count, int stride);
+void copyListViews(ObjList* list);
 bool isValidListIndex(ObjList* list, int index);
 bool isValidTupleIndex(ObjTuple* tuple, int index);
 bool isValidStringIndex(ObjString* string, int index);
@@ -182,8 +327,15 @@ ObjClosure* newClosure(ObjFunction* function);
 ObjFunction* newFunction();
 ObjInstance* newInstance(ObjClass* klass);
 ObjNative* newNative(NativeFn functiom);
+ObjString* newString(int length);
+ObjString* internString(ObjString* string);
+ObjString* internLongString(ObjString* string);
+bool stringsEqual(ObjString* a, ObjString* b);
 ObjString* takeString(char* chars, int length);
 ObjString* copyString(const char* chars, int length);
+Obj* joinStrings(Obj* a, Obj* b);
+Obj* sliceString(ObjString* string, int start, int length);
+ObjString* flattenRope(ObjRope* rope);
 ObjUpvalue* newUpvalue(Value* slot);
 
 ObjString* fromCString(const char * chars);
@@ -193,11 +345,65 @@ ObjectModule* fromFullPath(const char *fullpath);
 
 void printObject(Value value);
 
+/* The methods of a native class, loading them on first use */
+static inline Table* nativeClassMethods(ObjNativeClass* klass)
+{
+    if (klass->load != NULL)
+    {
+        ModuleLoader load = klass->load;
+        klass->load = NULL;
+        load(klass);
+    }
+    return &klass->methods;
+}
+
+/* Get a value from a given index */
+static inline Value indexFromList(ObjList* list, int index)
+{
+    if (list->strategy == LIST_VIEW)
+    {
+        index = list->offset + index * list->stride;
+        list = list->parent;
+    }
+
+    if (list->strategy == LIST_NUMBERS) return NUMBER_VAL(list->numbers[index]);
+    return list->items[index];
+}
+
+/* Call before changing a list's items in place, a view gets its own copy
+ * of the items and so does every view of the list */
+static inline void unshareList(ObjList* list)
+{
+    if (list->strategy == LIST_VIEW || list->views != NULL)
+        copyListViews(list);
+}
+
 static inline bool isObjType(Value value, ObjType type)
 {
 	return IS_OBJ(value) && AS_OBJ(value)->type == type;
 }
 
+/* Get the interned version of a string, long strings are only hashed
+ * and interned the first time this is needed */
+static inline ObjString* internedString(ObjString* string)
+{
+	if (string->interned) return string;
+	return internLongString(string);
+}
+
+/* Strings and ropes can both be used wherever a string is expected */
+static inline bool isStringLike(Value value)
+{
+	return IS_STRING(value) || IS_ROPE(value);
+}
+
+/* Turn a rope into a plain string, anything else is left as it is */
+static inline Value flattenValue(Value value)
+{
+	if (IS_ROPE(value)) return OBJ_VAL(flattenRope(AS_ROPE(value)));
+	return value;
+}
+
 /* Used for modules */
 static inline ObjType getObjType(Value value) {
       return AS_OBJ(value)->type;
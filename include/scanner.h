@@ -49,5 +49,6 @@ typedef struct
 
 void initScanner(const char *src);
 Token scanToken();
+char peekTokenStart();
 
 #endif
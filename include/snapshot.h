@@ -0,0 +1,25 @@
+#ifndef mt_snapshot_h
+#define mt_snapshot_h
+
+#include "common.h"
+
+/* Heap images for fast startup. mt --snapshot runs a prelude and writes
+ * every object reachable from the vm to a file, mt --from-snapshot maps
+ * that file back in and relocates it instead of building the modules
+ * again. Objects in the image are never freed */
+
+extern uint8_t* snapshotStart;
+extern uint8_t* snapshotEnd;
+
+bool saveSnapshot(const char* path);
+bool loadSnapshot(const char* path);
+void unmapSnapshot();
+
+/* True if the memory belongs to a loaded image */
+static inline bool isSnapshotMemory(const void* pointer)
+{
+  return (const uint8_t*)pointer >= snapshotStart &&
+         (const uint8_t*)pointer < snapshotEnd;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef mt_stream_h
+#define mt_stream_h
+
+#include "object.h"
+
+/* Lazy pipelines over lists, ranges and anything for-in can walk. Each
+ * item is pulled through every stage before the next one is read */
+
+typedef enum
+{
+  STREAM_ITEM,
+  STREAM_END,
+  STREAM_ERROR,   // a callback raised a runtime error
+} StreamResult;
+
+ObjStream* streamFromValue(Value value);
+bool claimStream(ObjStream* stream);
+StreamResult nextFromStream(ObjStream* stream, Value* item);
+
+#endif
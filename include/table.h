@@ -4,7 +4,66 @@
 #include "common.h"
 #include "value.h"
 
-/* Implementation of hash tables for variable lookup */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Implementation of hash tables for variable lookup. Entries are split in
+ * groups of 16 slots with one control byte per slot holding 7 bits of the
+ * key's hash, so a whole group can be searched at once */
+
+#define TABLE_GROUP_SIZE 16
+
+/* Control byte values, full slots hold the low 7 bits of the hash */
+#define CONTROL_EMPTY   0x80
+#define CONTROL_DELETED 0xFE
+
+/* The high bits of the hash pick a key's home slot, which also decides
+ * the group probing starts from. The low 7 go in the control byte */
+#define HASH_SLOT(hash)    ((hash) >> 7)
+#define HASH_CONTROL(hash) ((uint8_t)((hash) & 0x7f))
+
+/* Bit i of the result is set if control[i] == byte */
+static inline uint32_t groupMatchByte(const uint8_t* control, uint8_t byte)
+{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i*)control);
+	return (uint32_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < TABLE_GROUP_SIZE; i++)
+	{
+		if (control[i] == byte) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+/* Bit i of the result is set if slot i is empty or deleted */
+static inline uint32_t groupMatchFree(const uint8_t* control)
+{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i*)control);
+	return (uint32_t)_mm_movemask_epi8(group);
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < TABLE_GROUP_SIZE; i++)
+	{
+		if (control[i] & 0x80) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+/* Groups are visited in triangular order which reaches every group when
+ * the number of groups is a power of two */
+#define FOR_EACH_GROUP(capacity, hash, group)                         \
+	for (int groupMask_ = (capacity) >> 4,                            \
+	         step_ = 0,                                               \
+	         group = (HASH_SLOT(hash) & (capacity)) >> 4;             \
+	     ;                                                            \
+	     group = (group + ++step_) & groupMask_)
 
 typedef struct
 {
@@ -14,9 +73,11 @@ typedef struct
 
 typedef struct
 {
-	int count;
-	int capacity;
+	int count;        // full slots plus tombstones
+	int tombstones;
+	int capacity;     // number of slots - 1
 	Entry* entries;
+	uint8_t* control; // one per slot
 } Table;
 
 void initTable(Table* table);
@@ -14,6 +14,8 @@
 #include "../module/math.h"
 #include "../module/strings.h"
 #include "../module/arrays.h"
+#include "../module/sets.h"
+#include "../module/stream.h"
 
 #define FRAMES_MAX 1024
 #define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
@@ -25,6 +27,9 @@ typedef struct {
   Value *slots;
 } CallFrame;
 
+/* Receives text the vm prints, it is not NUL terminated */
+typedef void (*WriteFn)(const char *text, size_t length, void *data);
+
 /* Executes chunks */
 
 /* Manage state of VM */
@@ -42,8 +47,18 @@ typedef struct {
   Table imports;
 
   ObjString* initString; // used to initialise functions
+  ObjString* charStrings[256]; // one char strings made by indexing
   ObjUpvalue* openUpvalues;
 
+  /* set once a built-in module's global is assigned to, which turns off
+   * the calls the compiler specialised for the modules */
+  bool modulesRebound;
+
+  /* where printing and errors go, stdout and stderr when NULL */
+  WriteFn writeOutput;
+  WriteFn writeError;
+  void *writeData;
+
   Obj *objects;
 } VM;
 
@@ -55,11 +70,21 @@ typedef enum {
 
 extern VM vm;
 void runtimeError(const char *format, ...);
+void writeOutput(const char *format, ...);
+void writeError(const char *format, ...);
+void defineNative(const char *name, NativeFn function);
 bool isFalsey(Value value);
 void initVM();
+bool initVMFromSnapshot(const char* filePath, const char* imagePath);
 void freeVM();
 InterpretResult interpretModule(const char *source) ;
 InterpretResult interpret(const char *src);
+
+/* Call an mt value from a native and store what it returns in result.
+ * Returns false if the call raised a runtime error, in which case the
+ * native should stop and return straight away */
+bool vmCall(Value callee, Value *args, int argCount, Value *result);
+bool isCallable(Value value);
 void push(Value value);
 Value pop();
 
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "arrays.h"
 #include "../include/vm.h"
 #include "../include/object.h"
@@ -28,14 +30,9 @@ Value reverseNative(int argCount, Value *args) {
         return NIL_VAL;
     }
 
+    // a view walking the list backwards, copied once either is changed
     ObjList *list = AS_LIST(args[0]);
-    ObjList *new = newList();
-
-    for (int i = list->count - 1; i >= 0; i--) {
-        appendToList(new, list->items[i]);
-    }
-
-    return OBJ_VAL(new);
+    return OBJ_VAL(newListView(list, list->count - 1, list->count, -1));
 }
 
 // native push list
@@ -69,7 +66,11 @@ Value popNative(int argCount, Value *args) {
     }
 
     ObjList *list = AS_LIST(args[0]);
-    Value last = list->items[list->count - 1];
+    if (list->count == 0) {
+        return NIL_VAL;
+    }
+
+    Value last = indexFromList(list, list->count - 1);
     list->count--;
 
     return last;
@@ -88,11 +89,12 @@ Value shiftNative(int argCount, Value *args) {
     }
 
     ObjList *list = AS_LIST(args[0]);
-    Value first = list->items[0];
-    for (int i = 0; i < list->count - 1; i++) {
-        list->items[i] = list->items[i + 1];
+    if (list->count == 0) {
+        return NIL_VAL;
     }
-    list->count--;
+
+    Value first = indexFromList(list, 0);
+    deleteFromList(list, 0);
 
     return first;
 }
@@ -109,12 +111,7 @@ Value unshiftNative(int argCount, Value *args) {
         return NIL_VAL;
     }
 
-    ObjList *list = AS_LIST(args[0]);
-    for (int i = list->count; i > 0; i--) {
-        list->items[i] = list->items[i - 1];
-    }
-    list->items[0] = args[1];
-    list->count++;
+    prependToList(AS_LIST(args[0]), args[1]);
 
     return args[0];
 }
@@ -155,12 +152,8 @@ Value sliceNative(int argCount, Value *args) {
         return NIL_VAL;
     }
 
-    ObjList *new = newList();
-    for (int i = start; i < end; i++) {
-        appendToList(new, list->items[i]);
-    }
-
-    return OBJ_VAL(new);
+    // shares the items until either list is changed
+    return OBJ_VAL(newListView(list, start, end - start, 1));
 }
 
 // native function to create a new list populated with random values
@@ -189,15 +182,163 @@ Value randNative(int argCount, Value *args) {
     return OBJ_VAL(list);
 }
 
-void createArraysModule() 
+// native function to create a zero filled Float64 array
+Value zerosNative(int argCount, Value *args) {
+    if (argCount != 1) {
+        runtimeError("wrong number of arguments. got=%d, want=1", argCount);
+        return NIL_VAL;
+    }
+
+    if (!IS_NUMBER(args[0]) || AS_NUMBER(args[0]) < 0) {
+        runtimeError("argument to `Zeros` must be a positive number");
+        return NIL_VAL;
+    }
+
+    return OBJ_VAL(newFloatArray(AS_NUMBER(args[0])));
+}
+
+// native function to copy a list of numbers into a Float64 array
+Value float64Native(int argCount, Value *args) {
+    if (argCount != 1) {
+        runtimeError("wrong number of arguments. got=%d, want=1", argCount);
+        return NIL_VAL;
+    }
+
+    if (!IS_LIST(args[0])) {
+        runtimeError("argument to `Float64` not an array");
+        return NIL_VAL;
+    }
+
+    ObjList *list = AS_LIST(args[0]);
+    if (!specialiseList(list)) {
+        runtimeError("`Float64` arrays can only hold numbers");
+        return NIL_VAL;
+    }
+
+    ObjFloatArray *array = newFloatArray(list->count);
+    memcpy(array->items, list->numbers, sizeof(double) * list->count);
+
+    return OBJ_VAL(array);
+}
+
+// native function to copy a Float64 array back into a list
+Value toListNative(int argCount, Value *args) {
+    if (argCount != 1) {
+        runtimeError("wrong number of arguments. got=%d, want=1", argCount);
+        return NIL_VAL;
+    }
+
+    if (!IS_FLOAT_ARRAY(args[0])) {
+        runtimeError("argument to `ToList` not a Float64 array");
+        return NIL_VAL;
+    }
+
+    return OBJ_VAL(floatArrayToList(AS_FLOAT_ARRAY(args[0])));
+}
+
+/* Check the (list, fn) arguments shared by the higher order natives */
+static bool listAndCallback(int argCount, Value *args, int want, const char *name)
 {
-  ObjString* name = copyString("arrays", 6);
-  push(OBJ_VAL(name));
+    if (argCount != want) {
+        runtimeError("wrong number of arguments. got=%d, want=%d", argCount, want);
+        return false;
+    }
+
+    if (!IS_LIST(args[0])) {
+        runtimeError("argument to `%s` not an array", name);
+        return false;
+    }
+
+    if (!isCallable(args[1])) {
+        runtimeError("second argument to `%s` must be a function", name);
+        return false;
+    }
+
+    return true;
+}
+
+// native function to build a list from fn(item) for every item
+Value mapNative(int argCount, Value *args) {
+    if (!listAndCallback(argCount, args, 2, "Map"))
+        return NIL_VAL;
+
+    ObjList *list = AS_LIST(args[0]);
+    ObjList *result = newList();
 
-  // now create the runtime object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
+    // count is re-read each time in case the callback changes the list
+    for (int i = 0; i < list->count; i++) {
+        Value item = indexFromList(list, i);
+        Value mapped;
 
+        if (!vmCall(args[1], &item, 1, &mapped))
+            return NIL_VAL;
+
+        appendToList(result, mapped);
+    }
+
+    return OBJ_VAL(result);
+}
+
+// native function to keep the items fn(item) is truthy for
+Value filterNative(int argCount, Value *args) {
+    if (!listAndCallback(argCount, args, 2, "Filter"))
+        return NIL_VAL;
+
+    ObjList *list = AS_LIST(args[0]);
+    ObjList *result = newList();
+
+    for (int i = 0; i < list->count; i++) {
+        Value item = indexFromList(list, i);
+        Value keep;
+
+        if (!vmCall(args[1], &item, 1, &keep))
+            return NIL_VAL;
+
+        if (!isFalsey(keep))
+            appendToList(result, item);
+    }
+
+    return OBJ_VAL(result);
+}
+
+// native function to fold a list with fn(acc, item) from an initial value
+Value reduceNative(int argCount, Value *args) {
+    if (!listAndCallback(argCount, args, 3, "Reduce"))
+        return NIL_VAL;
+
+    ObjList *list = AS_LIST(args[0]);
+    Value pair[2] = {args[2], NIL_VAL};
+
+    for (int i = 0; i < list->count; i++) {
+        pair[1] = indexFromList(list, i);
+
+        if (!vmCall(args[1], pair, 2, &pair[0]))
+            return NIL_VAL;
+    }
+
+    return pair[0];
+}
+
+// native function to call fn(item) for every item
+Value eachNative(int argCount, Value *args) {
+    if (!listAndCallback(argCount, args, 2, "Each"))
+        return NIL_VAL;
+
+    ObjList *list = AS_LIST(args[0]);
+
+    for (int i = 0; i < list->count; i++) {
+        Value item = indexFromList(list, i);
+        Value ignored;
+
+        if (!vmCall(args[1], &item, 1, &ignored))
+            return NIL_VAL;
+    }
+
+    return NIL_VAL;
+}
+
+static void loadArraysModule(ObjNativeClass* klass)
+{
   defineModuleMethod(klass, "Len", lenNativeModule);
   defineModuleMethod(klass, "Reverse", reverseNative);
   defineModuleMethod(klass, "Push", pushNative);
@@ -206,8 +347,16 @@ void createArraysModule()
   defineModuleMethod(klass, "Unshift", unshiftNative);
   defineModuleMethod(klass, "Slice", sliceNative);
   defineModuleMethod(klass, "Rand", randNative);
+  defineModuleMethod(klass, "Zeros", zerosNative);
+  defineModuleMethod(klass, "Float64", float64Native);
+  defineModuleMethod(klass, "ToList", toListNative);
+  defineModuleMethod(klass, "Map", mapNative);
+  defineModuleMethod(klass, "Filter", filterNative);
+  defineModuleMethod(klass, "Reduce", reduceNative);
+  defineModuleMethod(klass, "Each", eachNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createArraysModule()
+{
+  defineModule("arrays", loadArraysModule);
 }
\ No newline at end of file
@@ -28,7 +28,7 @@ static Value assertIsTrue(int argCount, Value *args)
     {
       runtimeError("Fatal error in 'Assert.true', exiting...");
     }
-    exit(70);
+    return NIL_VAL;
   }
   return NIL_VAL;
 }
@@ -57,7 +57,7 @@ static Value assertIsFalse(int argCount, Value *args)
     {
       runtimeError("Fatal error in 'Assert.false', exiting...");
     }
-    exit(70);
+    return NIL_VAL;
   }
   return NIL_VAL;
 }
@@ -87,7 +87,7 @@ static Value assertEqualNative(int argCount, Value *args)
   if (!result) 
   {
     runtimeError("Could not assert all values to be equal.");
-    exit(70);
+    return NIL_VAL;
   }
 
   return NIL_VAL;
@@ -139,25 +139,17 @@ static Value assertString(int argCount, Value *args)
 
 
 /* Finally we create the module */
-void createAssertModule() 
+static void loadAssertModule(ObjNativeClass* klass)
 {
-  // name of the overall module
-  ObjString* name = copyString("assert", 6);
-  push(OBJ_VAL(name));
-
-  // we use the name to create the object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
   defineModuleMethod(klass, "True", assertIsTrue);
   defineModuleMethod(klass, "False", assertIsFalse);
   defineModuleMethod(klass, "Equals", assertEqualNative);
   defineModuleMethod(klass, "Number", assertNumber);
   defineModuleMethod(klass, "String", assertString);
+}
 
-
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createAssertModule()
+{
+  defineModule("assert", loadAssertModule);
 }
 
@@ -20,17 +20,12 @@ static Value errorRaise(int argCount, Value *args)
 }
 
 /* define the module */
-void createErrorsModule() 
-{ 
-  ObjString* name = copyString("errors", 6);
-  push(OBJ_VAL(name));
-
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
+static void loadErrorsModule(ObjNativeClass* klass)
+{
   defineModuleMethod(klass, "Raise", errorRaise);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createErrorsModule()
+{
+  defineModule("errors", loadErrorsModule);
 }
@@ -35,7 +35,7 @@ static Value httpGetNative(int argCount, Value* args)
 
  if (argCount == 0) 
  {
-  printf("Warning: Hostname not set, defaulting to 'mt-lang.org'.\n");
+  writeError("Warning: Hostname not set, defaulting to 'mt-lang.org'.\n");
  }
 
  // if hostname is not provided we default to 'mt-lang.org'
@@ -137,20 +137,13 @@ static Value httpGetNative(int argCount, Value* args)
 
 
 /* Finally we create the module */
-void createHttpModule() 
+static void loadHttpModule(ObjNativeClass* klass)
 {
-  // name of the overall module
-  ObjString* name = copyString("http", 4);
-  push(OBJ_VAL(name));
-
-  // we use the name to create the object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
   defineModuleMethod(klass, "Get", httpGetNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createHttpModule()
+{
+  defineModule("http", loadHttpModule);
 }
 
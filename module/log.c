@@ -24,20 +24,20 @@ static Value logPrintNative(int argCount, Value *args)
 
   if (argCount == 0) 
   {
-    printf("%s\n", time);
+    writeOutput("%s\n", time);
   }
 
   if (argCount > 1) 
   {
     runtimeError("Too many arguments to 'log.Print', expected 1 got '%d%", argCount);
-    printf("Perhaps you meant to use 'log.Printf'?\n");
-    exit(74);
+    writeError("Perhaps you meant to use 'log.Printf'?\n");
+    return NIL_VAL;
   }
 
   if (time[strlen(time) - 1] == '\n')
    time[strlen(time)-1] = '\0';
   
-  printf("%s: %s\n", time, AS_CSTRING(args[0]));
+  writeOutput("%s: %s\n", time, AS_CSTRING(args[0]));
 
   return NUMBER_VAL(0);
 }
@@ -46,40 +46,33 @@ static Value logPrintNative(int argCount, Value *args)
 static Value logFatalNative(int argCount, Value *args) 
 {
 #ifndef _WIN32
-  printf(RED);
+  writeOutput(RED);
 #endif
   if (argCount != 1) 
   {
     runtimeError("Expected 1 argument to 'log.Fatal' got %d", argCount);
-    exit(74);
+    return NIL_VAL;
   }
 
   // print the error
-  printf("%s\n", AS_CSTRING(args[0]));
+  writeOutput("%s\n", AS_CSTRING(args[0]));
 
   // exit 
   exit(74);
 
 #ifndef _WIN32
-  printf(RESET);
+  writeOutput(RESET);
 #endif
 }
 
 /* Create a fake class for the log library  */
-void createLogModule() 
+static void loadLogModule(ObjNativeClass* klass)
 {
-  // name of the overall module
-  ObjString* name = copyString("log", 3);
-  push(OBJ_VAL(name));
-
-  // we use the name to create the object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
   defineModuleMethod(klass, "Print", logPrintNative);
   defineModuleMethod(klass, "Fatal", logFatalNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createLogModule()
+{
+  defineModule("log", loadLogModule);
 }
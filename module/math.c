@@ -63,6 +63,12 @@ static Value powNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]) || !IS_NUMBER(args[1]))
+  {
+    runtimeError("Arguments to 'math.Pow' must be numbers.");
+    return NIL_VAL;
+  }
+
   double base = AS_NUMBER(args[0]);
   double exponent = AS_NUMBER(args[1]);
   return NUMBER_VAL(pow(base, exponent));
@@ -78,6 +84,12 @@ static Value sqrtNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Sqrt' must be a number.");
+    return NIL_VAL;
+  }
+
   double n = AS_NUMBER(args[0]);
   return NUMBER_VAL(sqrt(n));
 }
@@ -92,6 +104,12 @@ static Value absNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Abs' must be a number.");
+    return NIL_VAL;
+  }
+
   double n = AS_NUMBER(args[0]);
   return NUMBER_VAL(fabs(n));
 }
@@ -108,6 +126,12 @@ static Value sinNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Sin' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(sin(radians));
 }
@@ -122,6 +146,12 @@ static Value cosNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Cos' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(cos(radians));
 }
@@ -136,6 +166,12 @@ static Value tanNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Tan' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(tan(radians));
 }
@@ -150,6 +186,12 @@ static Value asinNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Asin' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(asin(radians));
 }
@@ -164,6 +206,12 @@ static Value acosNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Acos' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(acos(radians));
 }
@@ -178,6 +226,12 @@ static Value atanNative(int argCount, Value *args)
     return NIL_VAL;
   }
 
+  if (!IS_NUMBER(args[0]))
+  {
+    runtimeError("Argument to 'math.Atan' must be a number.");
+    return NIL_VAL;
+  }
+
   double radians = AS_NUMBER(args[0]);
   return NUMBER_VAL(atan(radians));
 }
@@ -210,31 +264,24 @@ static Value eNative(int argCount, Value *args)
   return NUMBER_VAL(M_E);
 }
 
-void createMathModule()
+static void loadMathModule(ObjNativeClass* klass)
 {
-  // set up the name of the module
-  ObjString* name = copyString("math", 4);
-  push(OBJ_VAL(name));
-
-  // now create the runtime object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
   defineModuleMethod(klass, "Fac", factorial);
-  defineModuleMethod(klass, "Sin", sinNative);
-  defineModuleMethod(klass, "Cos", cosNative);
-  defineModuleMethod(klass, "Tan", tanNative);
-  defineModuleMethod(klass, "Asin", asinNative);
-  defineModuleMethod(klass, "Acos", acosNative);
-  defineModuleMethod(klass, "Atan", atanNative);
+  defineUnaryModuleMethod(klass, "Sin", sinNative, sin);
+  defineUnaryModuleMethod(klass, "Cos", cosNative, cos);
+  defineUnaryModuleMethod(klass, "Tan", tanNative, tan);
+  defineUnaryModuleMethod(klass, "Asin", asinNative, asin);
+  defineUnaryModuleMethod(klass, "Acos", acosNative, acos);
+  defineUnaryModuleMethod(klass, "Atan", atanNative, atan);
   defineModuleMethod(klass, "Pi", piNative);
   defineModuleMethod(klass, "E", eNative);
-  defineModuleMethod(klass, "Pow", powNative);
-  defineModuleMethod(klass, "Sqrt", sqrtNative);
-  defineModuleMethod(klass, "Abs", absNative);
+  defineBinaryModuleMethod(klass, "Pow", powNative, pow);
+  defineUnaryModuleMethod(klass, "Sqrt", sqrtNative, sqrt);
+  defineUnaryModuleMethod(klass, "Abs", absNative, fabs);
   defineModuleMethod(klass, "Range", rangeNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createMathModule()
+{
+  defineModule("math", loadMathModule);
 }
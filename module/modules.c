@@ -1,13 +1,55 @@
 #include "modules.h"
 
-/* Create native classses as well as functions */
-void defineModuleMethod(ObjNativeClass* klass, const char* name, NativeFn function) 
+static ObjNative* addModuleMethod(ObjNativeClass* klass, const char* name, NativeFn function)
 {
     ObjNative *native = newNative(function);
     push(OBJ_VAL(native));
     ObjString *methodName = copyString(name, strlen(name));
     push(OBJ_VAL(methodName));
     tableSet(&klass->methods, methodName, OBJ_VAL(native));
+    native->module = klass->name;
+    native->name = methodName;
     pop();
     pop();
+    return native;
+}
+
+/* Add a built-in module as a global. Its methods are only added by load
+ * once something uses the module, so unused modules cost next to nothing
+ * at startup. A NULL load defines a module the caller fills in itself */
+ObjNativeClass* defineModule(const char* name, ModuleLoader load)
+{
+    ObjString *moduleName = copyString(name, strlen(name));
+    push(OBJ_VAL(moduleName));
+    ObjNativeClass *klass = newNativeClass(moduleName);
+    klass->load = load;
+    push(OBJ_VAL(klass));
+    tableSet(&vm.globals, moduleName, OBJ_VAL(klass));
+    pop();
+    pop();
+    return klass;
+}
+
+/* Create native classses as well as functions */
+void defineModuleMethod(ObjNativeClass* klass, const char* name, NativeFn function) 
+{
+    addModuleMethod(klass, name, function);
+}
+
+/* Natives of one number that the vm calls directly, the generic function
+ * still handles anything else it is given */
+void defineUnaryModuleMethod(ObjNativeClass* klass, const char* name,
+                             NativeFn function, UnaryNumberFn unary)
+{
+    ObjNative *native = addModuleMethod(klass, name, function);
+    native->numberArity = 1;
+    native->unary = unary;
+}
+
+void defineBinaryModuleMethod(ObjNativeClass* klass, const char* name,
+                              NativeFn function, BinaryNumberFn binary)
+{
+    ObjNative *native = addModuleMethod(klass, name, function);
+    native->numberArity = 2;
+    native->binary = binary;
 }
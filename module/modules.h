@@ -5,6 +5,11 @@
 #include "../include/vm.h"
 #include "../include/value.h"
 
+ObjNativeClass* defineModule(const char* name, ModuleLoader load);
 void defineModuleMethod(ObjNativeClass* klass, const char* name, NativeFn function);
+void defineUnaryModuleMethod(ObjNativeClass* klass, const char* name,
+                             NativeFn function, UnaryNumberFn unary);
+void defineBinaryModuleMethod(ObjNativeClass* klass, const char* name,
+                              NativeFn function, BinaryNumberFn binary);
 
 #endif  // mt_modules_driver
@@ -0,0 +1,202 @@
+#include "sets.h"
+#include "../include/map.h"
+
+/* Check an argument is a set, naming the method in the error */
+static bool checkSet(Value value, const char* method) {
+  if (!IS_SET(value)) {
+    runtimeError("argument to 'sets.%s' must be a set", method);
+    return false;
+  }
+  return true;
+}
+
+/* Check a value can be stored in a set */
+static bool checkItem(Value value, const char* method) {
+  if (!isHashable(value)) {
+    runtimeError("sets.%s: item must be a number, string, bool, nil or tuple", method);
+    return false;
+  }
+  return true;
+}
+
+// sets.New() or sets.New(list)
+static Value newSetNative(int argCount, Value* args) {
+  if (argCount > 1) {
+    runtimeError("wrong number of arguments to 'sets.New'. got=%d, want=0 or 1", argCount);
+    return NIL_VAL;
+  }
+
+  ObjSet* set = newSet();
+  if (argCount == 0) return OBJ_VAL(set);
+
+  if (!IS_LIST(args[0])) {
+    runtimeError("argument to 'sets.New' must be a list");
+    return NIL_VAL;
+  }
+
+  ObjList* list = AS_LIST(args[0]);
+  mapReserve(set, list->count);
+  for (int i = 0; i < list->count; i++) {
+    Value item = indexFromList(list, i);
+    if (!checkItem(item, "New")) return NIL_VAL;
+    mapSet(set, item, NIL_VAL);
+  }
+
+  return OBJ_VAL(set);
+}
+
+// sets.Add(set, item), true if the item was not already there
+static Value addNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Add'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Add") || !checkItem(args[1], "Add")) return NIL_VAL;
+
+  return BOOL_VAL(mapSet(AS_SET(args[0]), args[1], NIL_VAL));
+}
+
+// sets.Remove(set, item), true if the item was there
+static Value removeNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Remove'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Remove")) return NIL_VAL;
+  if (!isHashable(args[1])) return BOOL_VAL(false);
+
+  return BOOL_VAL(mapDelete(AS_SET(args[0]), args[1]));
+}
+
+// sets.Contains(set, item), the same as item in set
+static Value containsNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Contains'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Contains")) return NIL_VAL;
+  if (!isHashable(args[1])) return BOOL_VAL(false);
+
+  Value unused;
+  return BOOL_VAL(mapGet(AS_SET(args[0]), args[1], &unused));
+}
+
+/* Add every item of from to set */
+static void addAll(ObjSet* set, ObjSet* from) {
+  for (int i = 0; i <= from->capacity; i++) {
+    if (from->control[i] & 0x80) continue;
+    mapSet(set, from->entries[i].key, NIL_VAL);
+  }
+}
+
+// sets.Union(a, b)
+static Value unionNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Union'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Union") || !checkSet(args[1], "Union")) return NIL_VAL;
+
+  ObjSet* a = AS_SET(args[0]);
+  ObjSet* b = AS_SET(args[1]);
+
+  ObjSet* result = newSet();
+  mapReserve(result, a->count + b->count);
+  addAll(result, a);
+  addAll(result, b);
+
+  return OBJ_VAL(result);
+}
+
+// sets.Intersection(a, b)
+static Value intersectionNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Intersection'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Intersection") || !checkSet(args[1], "Intersection"))
+    return NIL_VAL;
+
+  // walk the smaller set and probe the larger one
+  ObjSet* small = AS_SET(args[0]);
+  ObjSet* large = AS_SET(args[1]);
+  if (small->count > large->count) {
+    ObjSet* temp = small;
+    small = large;
+    large = temp;
+  }
+
+  ObjSet* result = newSet();
+  mapReserve(result, small->count);
+
+  Value unused;
+  for (int i = 0; i <= small->capacity; i++) {
+    if (small->control[i] & 0x80) continue;
+
+    Value item = small->entries[i].key;
+    if (mapGet(large, item, &unused)) mapSet(result, item, NIL_VAL);
+  }
+
+  return OBJ_VAL(result);
+}
+
+// sets.Difference(a, b), the items of a that are not in b
+static Value differenceNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sets.Difference'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "Difference") || !checkSet(args[1], "Difference"))
+    return NIL_VAL;
+
+  ObjSet* a = AS_SET(args[0]);
+  ObjSet* b = AS_SET(args[1]);
+
+  ObjSet* result = newSet();
+  mapReserve(result, a->count);
+
+  Value unused;
+  for (int i = 0; i <= a->capacity; i++) {
+    if (a->control[i] & 0x80) continue;
+
+    Value item = a->entries[i].key;
+    if (!mapGet(b, item, &unused)) mapSet(result, item, NIL_VAL);
+  }
+
+  return OBJ_VAL(result);
+}
+
+// sets.ToList(set)
+static Value toListNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'sets.ToList'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  if (!checkSet(args[0], "ToList")) return NIL_VAL;
+
+  return OBJ_VAL(mapKeys(AS_SET(args[0])));
+}
+
+static void loadSetsModule(ObjNativeClass* klass)
+{
+  defineModuleMethod(klass, "New", newSetNative);
+  defineModuleMethod(klass, "Add", addNative);
+  defineModuleMethod(klass, "Remove", removeNative);
+  defineModuleMethod(klass, "Contains", containsNative);
+  defineModuleMethod(klass, "Union", unionNative);
+  defineModuleMethod(klass, "Intersection", intersectionNative);
+  defineModuleMethod(klass, "Difference", differenceNative);
+  defineModuleMethod(klass, "ToList", toListNative);
+}
+
+void createSetsModule()
+{
+  defineModule("sets", loadSetsModule);
+}
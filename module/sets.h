@@ -0,0 +1,9 @@
+#ifndef mt_module_sets
+#define mt_module_sets
+
+#include "modules.h"
+#include "../include/vm.h"
+
+void createSetsModule();
+
+#endif  // mt_module_sets
@@ -0,0 +1,416 @@
+/* Sorting algorithms used by the sorts module. This file is included once
+ * for each kind of item, with these defined first:
+ *
+ *   SORT_TYPE        the item type
+ *   SORT_LESS(a, b)  true if a sorts before b
+ *   SORT_NAME(name)  prefixes name so each include gets its own functions
+ *
+ * pdqsort is Orson Peters' pattern-defeating quicksort without the block
+ * partitioning. The stable sort is a TimSort that merges natural runs,
+ * trimming what is already in place instead of galloping */
+
+#define SORT_SWAP(a, b)        \
+  do {                         \
+    SORT_TYPE swapTemp = (a);  \
+    (a) = (b);                 \
+    (b) = swapTemp;            \
+  } while (false)
+
+/* Insertion sort items[begin, end) */
+static void SORT_NAME(insertionSort)(SORT_TYPE* items, int begin, int end) {
+  for (int cur = begin + 1; cur < end; cur++) {
+    if (!SORT_LESS(items[cur], items[cur - 1])) continue;
+
+    SORT_TYPE temp = items[cur];
+    int sift = cur;
+    do {
+      items[sift] = items[sift - 1];
+      sift--;
+    } while (sift != begin && SORT_LESS(temp, items[sift - 1]));
+    items[sift] = temp;
+  }
+}
+
+/* Insertion sort when the item before begin is no bigger than any in the
+ * range, so the inner loop needs no bounds check */
+static void SORT_NAME(unguardedInsertionSort)(SORT_TYPE* items, int begin,
+                                              int end) {
+  for (int cur = begin + 1; cur < end; cur++) {
+    if (!SORT_LESS(items[cur], items[cur - 1])) continue;
+
+    SORT_TYPE temp = items[cur];
+    int sift = cur;
+    do {
+      items[sift] = items[sift - 1];
+      sift--;
+    } while (SORT_LESS(temp, items[sift - 1]));
+    items[sift] = temp;
+  }
+}
+
+/* Insertion sort that gives up after moving a few items, used to finish
+ * ranges that look sorted already */
+static bool SORT_NAME(partialInsertionSort)(SORT_TYPE* items, int begin,
+                                            int end) {
+  int moved = 0;
+  for (int cur = begin + 1; cur < end; cur++) {
+    if (!SORT_LESS(items[cur], items[cur - 1])) continue;
+
+    SORT_TYPE temp = items[cur];
+    int sift = cur;
+    do {
+      items[sift] = items[sift - 1];
+      sift--;
+    } while (sift != begin && SORT_LESS(temp, items[sift - 1]));
+    items[sift] = temp;
+
+    moved += cur - sift;
+    if (moved > PDQ_PARTIAL_INSERTION_LIMIT) return false;
+  }
+  return true;
+}
+
+static inline void SORT_NAME(sort2)(SORT_TYPE* items, int a, int b) {
+  if (SORT_LESS(items[b], items[a])) SORT_SWAP(items[a], items[b]);
+}
+
+static inline void SORT_NAME(sort3)(SORT_TYPE* items, int a, int b, int c) {
+  SORT_NAME(sort2)(items, a, b);
+  SORT_NAME(sort2)(items, b, c);
+  SORT_NAME(sort2)(items, a, b);
+}
+
+static void SORT_NAME(siftDown)(SORT_TYPE* items, int begin, int root,
+                                int size) {
+  for (;;) {
+    int child = 2 * root + 1;
+    if (child >= size) return;
+    if (child + 1 < size &&
+        SORT_LESS(items[begin + child], items[begin + child + 1])) {
+      child++;
+    }
+    if (!SORT_LESS(items[begin + root], items[begin + child])) return;
+    SORT_SWAP(items[begin + root], items[begin + child]);
+    root = child;
+  }
+}
+
+/* Used once too many partitions have been badly unbalanced */
+static void SORT_NAME(heapSort)(SORT_TYPE* items, int begin, int end) {
+  int size = end - begin;
+  for (int i = size / 2 - 1; i >= 0; i--) {
+    SORT_NAME(siftDown)(items, begin, i, size);
+  }
+  for (int i = size - 1; i > 0; i--) {
+    SORT_SWAP(items[begin], items[begin + i]);
+    SORT_NAME(siftDown)(items, begin, 0, i);
+  }
+}
+
+/* Partition around items[begin], items equal to the pivot go right.
+ * Returns where the pivot ends up and whether nothing had to move */
+static int SORT_NAME(partitionRight)(SORT_TYPE* items, int begin, int end,
+                                     bool* alreadyPartitioned) {
+  SORT_TYPE pivot = items[begin];
+  int first = begin;
+  int last = end;
+
+  while (SORT_LESS(items[++first], pivot));
+
+  if (first - 1 == begin) {
+    while (first < last && !SORT_LESS(items[--last], pivot));
+  } else {
+    while (!SORT_LESS(items[--last], pivot));
+  }
+
+  *alreadyPartitioned = first >= last;
+
+  while (first < last) {
+    SORT_SWAP(items[first], items[last]);
+    while (SORT_LESS(items[++first], pivot));
+    while (!SORT_LESS(items[--last], pivot));
+  }
+
+  int pivotIndex = first - 1;
+  items[begin] = items[pivotIndex];
+  items[pivotIndex] = pivot;
+  return pivotIndex;
+}
+
+/* Partition with items equal to the pivot going left. Used when the pivot
+ * equals the item before the range, so a run of equal items is done in
+ * one step */
+static int SORT_NAME(partitionLeft)(SORT_TYPE* items, int begin, int end) {
+  SORT_TYPE pivot = items[begin];
+  int first = begin;
+  int last = end;
+
+  while (SORT_LESS(pivot, items[--last]));
+
+  if (last + 1 == end) {
+    while (first < last && !SORT_LESS(pivot, items[++first]));
+  } else {
+    while (!SORT_LESS(pivot, items[++first]));
+  }
+
+  while (first < last) {
+    SORT_SWAP(items[first], items[last]);
+    while (SORT_LESS(pivot, items[--last]));
+    while (!SORT_LESS(pivot, items[++first]));
+  }
+
+  items[begin] = items[last];
+  items[last] = pivot;
+  return last;
+}
+
+static void SORT_NAME(pdqLoop)(SORT_TYPE* items, int begin, int end,
+                               int badAllowed, bool leftmost) {
+  for (;;) {
+    int size = end - begin;
+
+    if (size < PDQ_INSERTION_THRESHOLD) {
+      if (leftmost) SORT_NAME(insertionSort)(items, begin, end);
+      else SORT_NAME(unguardedInsertionSort)(items, begin, end);
+      return;
+    }
+
+    // median of three, or the pseudo median of nine for big ranges
+    int half = size / 2;
+    if (size > PDQ_NINTHER_THRESHOLD) {
+      SORT_NAME(sort3)(items, begin, begin + half, end - 1);
+      SORT_NAME(sort3)(items, begin + 1, begin + half - 1, end - 2);
+      SORT_NAME(sort3)(items, begin + 2, begin + half + 1, end - 3);
+      SORT_NAME(sort3)(items, begin + half - 1, begin + half,
+                       begin + half + 1);
+      SORT_SWAP(items[begin], items[begin + half]);
+    } else {
+      SORT_NAME(sort3)(items, begin + half, begin, end - 1);
+    }
+
+    // the pivot equals an item already placed to the left, so everything
+    // equal to it can be skipped over
+    if (!leftmost && !SORT_LESS(items[begin - 1], items[begin])) {
+      begin = SORT_NAME(partitionLeft)(items, begin, end) + 1;
+      continue;
+    }
+
+    bool alreadyPartitioned;
+    int pivot = SORT_NAME(partitionRight)(items, begin, end,
+                                          &alreadyPartitioned);
+
+    int leftSize = pivot - begin;
+    int rightSize = end - (pivot + 1);
+
+    if (leftSize < size / 8 || rightSize < size / 8) {
+      // a bad split, fall back to heap sort if it keeps happening and
+      // otherwise shuffle some items to break up the pattern
+      if (--badAllowed == 0) {
+        SORT_NAME(heapSort)(items, begin, end);
+        return;
+      }
+
+      if (leftSize >= PDQ_INSERTION_THRESHOLD) {
+        SORT_SWAP(items[begin], items[begin + leftSize / 4]);
+        SORT_SWAP(items[pivot - 1], items[pivot - leftSize / 4]);
+
+        if (leftSize > PDQ_NINTHER_THRESHOLD) {
+          SORT_SWAP(items[begin + 1], items[begin + leftSize / 4 + 1]);
+          SORT_SWAP(items[begin + 2], items[begin + leftSize / 4 + 2]);
+          SORT_SWAP(items[pivot - 2], items[pivot - leftSize / 4 - 1]);
+          SORT_SWAP(items[pivot - 3], items[pivot - leftSize / 4 - 2]);
+        }
+      }
+
+      if (rightSize >= PDQ_INSERTION_THRESHOLD) {
+        SORT_SWAP(items[pivot + 1], items[pivot + 1 + rightSize / 4]);
+        SORT_SWAP(items[end - 1], items[end - rightSize / 4]);
+
+        if (rightSize > PDQ_NINTHER_THRESHOLD) {
+          SORT_SWAP(items[pivot + 2], items[pivot + 2 + rightSize / 4]);
+          SORT_SWAP(items[pivot + 3], items[pivot + 3 + rightSize / 4]);
+          SORT_SWAP(items[end - 2], items[end - 1 - rightSize / 4]);
+          SORT_SWAP(items[end - 3], items[end - 2 - rightSize / 4]);
+        }
+      }
+    } else if (alreadyPartitioned &&
+               SORT_NAME(partialInsertionSort)(items, begin, pivot) &&
+               SORT_NAME(partialInsertionSort)(items, pivot + 1, end)) {
+      // the range looked sorted and was
+      return;
+    }
+
+    // recurse into the left side and loop on the right
+    SORT_NAME(pdqLoop)(items, begin, pivot, badAllowed, leftmost);
+    begin = pivot + 1;
+    leftmost = false;
+  }
+}
+
+/* Unstable sort of count items */
+/* inline so includes that only need the stable sort do not warn */
+static inline void SORT_NAME(pdqSort)(SORT_TYPE* items, int count) {
+  if (count < 2) return;
+
+  int badAllowed = 1;
+  while ((1 << badAllowed) <= count) badAllowed++;
+
+  SORT_NAME(pdqLoop)(items, 0, count, badAllowed, true);
+}
+
+/* Insert items[sorted, end) into the sorted items[begin, sorted). Equal
+ * items are placed after the ones already there to keep the sort stable */
+static void SORT_NAME(binaryInsertionSort)(SORT_TYPE* items, int begin,
+                                           int sorted, int end) {
+  for (int cur = sorted; cur < end; cur++) {
+    SORT_TYPE temp = items[cur];
+    int low = begin;
+    int high = cur;
+
+    while (low < high) {
+      int middle = low + (high - low) / 2;
+      if (SORT_LESS(temp, items[middle])) high = middle;
+      else low = middle + 1;
+    }
+
+    memmove(&items[low + 1], &items[low], sizeof(SORT_TYPE) * (cur - low));
+    items[low] = temp;
+  }
+}
+
+/* Length of the run starting at begin, a strictly descending run is
+ * reversed so every run ends up ascending */
+static int SORT_NAME(countRun)(SORT_TYPE* items, int begin, int end) {
+  int cur = begin + 1;
+  if (cur == end) return 1;
+
+  if (SORT_LESS(items[cur], items[begin])) {
+    while (cur + 1 < end && SORT_LESS(items[cur + 1], items[cur])) cur++;
+
+    for (int low = begin, high = cur; low < high; low++, high--) {
+      SORT_SWAP(items[low], items[high]);
+    }
+  } else {
+    while (cur + 1 < end && !SORT_LESS(items[cur + 1], items[cur])) cur++;
+  }
+
+  return cur + 1 - begin;
+}
+
+/* Merge the neighbouring sorted runs items[begin, middle) and
+ * items[middle, end) using scratch space for the left run */
+static void SORT_NAME(mergeRuns)(SORT_TYPE* items, SORT_TYPE* scratch,
+                                 int begin, int middle, int end) {
+  // items at the start of the left run that are no bigger than the first
+  // of the right run are already in place
+  int low = begin;
+  int high = middle;
+  while (low < high) {
+    int probe = low + (high - low) / 2;
+    if (SORT_LESS(items[middle], items[probe])) high = probe;
+    else low = probe + 1;
+  }
+  begin = low;
+  if (begin == middle) return;
+
+  // and so are items at the end of the right run that are no smaller
+  // than the last of the left run
+  low = middle;
+  high = end;
+  while (low < high) {
+    int probe = low + (high - low) / 2;
+    if (SORT_LESS(items[probe], items[middle - 1])) low = probe + 1;
+    else high = probe;
+  }
+  end = low;
+
+  int leftCount = middle - begin;
+  memcpy(scratch, &items[begin], sizeof(SORT_TYPE) * leftCount);
+
+  int left = 0;
+  int right = middle;
+  int dest = begin;
+
+  while (left < leftCount && right < end) {
+    // take from the right only when strictly smaller, this keeps it stable
+    if (SORT_LESS(items[right], scratch[left])) items[dest++] = items[right++];
+    else items[dest++] = scratch[left++];
+  }
+
+  memcpy(&items[dest], &scratch[left], sizeof(SORT_TYPE) * (leftCount - left));
+}
+
+/* Stable sort of count items */
+static inline void SORT_NAME(timSort)(SORT_TYPE* items, int count) {
+  if (count < 2) return;
+
+  // runs shorter than minRun are extended with insertion sort, chosen so
+  // the number of runs is a power of two or just under
+  int minRun = count;
+  int odd = 0;
+  while (minRun >= 64) {
+    odd |= minRun & 1;
+    minRun >>= 1;
+  }
+  minRun += odd;
+
+  SORT_TYPE* scratch = ALLOCATE(SORT_TYPE, count);
+  int runStart[TIMSORT_MAX_RUNS];
+  int runLength[TIMSORT_MAX_RUNS];
+  int runs = 0;
+
+  for (int begin = 0; begin < count;) {
+    int length = SORT_NAME(countRun)(items, begin, count);
+
+    if (length < minRun) {
+      int extended = count - begin < minRun ? count - begin : minRun;
+      SORT_NAME(binaryInsertionSort)(items, begin, begin + length,
+                                     begin + extended);
+      length = extended;
+    }
+
+    runStart[runs] = begin;
+    runLength[runs] = length;
+    runs++;
+    begin += length;
+
+    // merge until the run lengths shrink fast enough going up the stack,
+    // which keeps the stack short and the merges balanced
+    while (runs > 1) {
+      int n = runs - 2;
+      if ((n > 0 && runLength[n - 1] <= runLength[n] + runLength[n + 1]) ||
+          (n > 1 && runLength[n - 2] <= runLength[n - 1] + runLength[n])) {
+        if (runLength[n - 1] < runLength[n + 1]) n--;
+      } else if (runLength[n] > runLength[n + 1]) {
+        break;
+      }
+
+      SORT_NAME(mergeRuns)(items, scratch, runStart[n], runStart[n + 1],
+                           runStart[n + 1] + runLength[n + 1]);
+      runLength[n] += runLength[n + 1];
+      for (int i = n + 1; i < runs - 1; i++) {
+        runStart[i] = runStart[i + 1];
+        runLength[i] = runLength[i + 1];
+      }
+      runs--;
+    }
+  }
+
+  while (runs > 1) {
+    int n = runs - 2;
+    if (n > 0 && runLength[n - 1] < runLength[n + 1]) n--;
+
+    SORT_NAME(mergeRuns)(items, scratch, runStart[n], runStart[n + 1],
+                         runStart[n + 1] + runLength[n + 1]);
+    runLength[n] += runLength[n + 1];
+    for (int i = n + 1; i < runs - 1; i++) {
+      runStart[i] = runStart[i + 1];
+      runLength[i] = runLength[i + 1];
+    }
+    runs--;
+  }
+
+  FREE_ARRAY(SORT_TYPE, scratch, count);
+}
+
+#undef SORT_SWAP
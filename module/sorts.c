@@ -1,4 +1,83 @@
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
 #include "sorts.h"
+#include "../include/memory.h"
+
+#define PDQ_INSERTION_THRESHOLD 24
+#define PDQ_NINTHER_THRESHOLD 128
+#define PDQ_PARTIAL_INSERTION_LIMIT 8
+
+/* Enough for any list an int can count */
+#define TIMSORT_MAX_RUNS 85
+
+/* Strings order by their bytes, a prefix before anything longer */
+static inline bool stringLess(Value a, Value b) {
+  ObjString* left = AS_STRING(a);
+  ObjString* right = AS_STRING(b);
+  int length = left->length < right->length ? left->length : right->length;
+  int order = memcmp(left->chars, right->chars, length);
+  return order < 0 || (order == 0 && left->length < right->length);
+}
+
+#define SORT_TYPE double
+#define SORT_LESS(a, b) ((a) < (b))
+#define SORT_NAME(name) numbers_##name
+#include "sortimpl.h"
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_NAME
+
+#define SORT_TYPE Value
+#define SORT_LESS(a, b) stringLess(a, b)
+#define SORT_NAME(name) strings_##name
+#include "sortimpl.h"
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_NAME
+
+/* SortBy sorts items paired with the key computed for them */
+typedef struct {
+  Value key;
+  Value item;
+} KeyedItem;
+
+#define SORT_TYPE KeyedItem
+#define SORT_LESS(a, b) (AS_NUMBER((a).key) < AS_NUMBER((b).key))
+#define SORT_NAME(name) numberKeys_##name
+#include "sortimpl.h"
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_NAME
+
+#define SORT_TYPE KeyedItem
+#define SORT_LESS(a, b) stringLess((a).key, (b).key)
+#define SORT_NAME(name) stringKeys_##name
+#include "sortimpl.h"
+#undef SORT_TYPE
+#undef SORT_LESS
+#undef SORT_NAME
+
+/* The sorts work on unboxed numbers, so the list is switched to its
+ * number storage first. Reports an error if that is not possible */
+static bool numberList(Value value, const char* name) {
+  if (!IS_LIST(value)) {
+    runtimeError("%s: argument is not a list", name);
+    return false;
+  }
+
+  ObjList* list = AS_LIST(value);
+  if (specialiseList(list)) return true;
+
+  for (int i = 0; i < list->count; i++) {
+    if (!IS_NUMBER(list->items[i])) {
+      runtimeError("%s: argument is not a number at index=%d", name, i);
+      break;
+    }
+  }
+  return false;
+}
 
 static Value bubbleSortNative(int argCount, Value* args) {
   // bubbleSort(array)
@@ -7,26 +86,16 @@ static Value bubbleSortNative(int argCount, Value* args) {
     return NIL_VAL;
   }
 
+  if (!numberList(args[0], "sorts.Bubble")) return NIL_VAL;
   ObjList* list = AS_LIST(args[0]);
+  double* items = list->numbers;
 
   for (int i = 0; i < list->count; i++) {
     for (int j = 0; j < list->count - i - 1; j++) {
-      // check list->items[j] is a number
-      if (!IS_NUMBER(list->items[j])) {
-        runtimeError("sorts.Bubble: argument is not a number at index=%d", j);
-        return NIL_VAL;
-      }
-
-      // do the same for j+1
-      if (!IS_NUMBER(list->items[j + 1])) {
-        runtimeError("sorts.Bubble: argument is not a number at index=%d", j + 1);
-        return NIL_VAL;
-      }
-
-      if (AS_NUMBER(list->items[j]) > AS_NUMBER(list->items[j + 1])) {
-        Value temp = list->items[j];
-        list->items[j] = list->items[j + 1];
-        list->items[j + 1] = temp;
+      if (items[j] > items[j + 1]) {
+        double temp = items[j];
+        items[j] = items[j + 1];
+        items[j + 1] = temp;
       }
     }
   }
@@ -42,38 +111,40 @@ static Value insertionSortNative(int argCount, Value* args) {
     return NIL_VAL;
   }
 
+  if (!numberList(args[0], "sorts.Insertion")) return NIL_VAL;
   ObjList* list = AS_LIST(args[0]);
+  double* items = list->numbers;
 
   for (int i = 1; i < list->count; i++) {
-    Value temp = list->items[i];
+    double temp = items[i];
     int j = i - 1;
 
-    while (j >= 0 && AS_NUMBER(list->items[j]) > AS_NUMBER(temp)) {
-      list->items[j + 1] = list->items[j];
+    while (j >= 0 && items[j] > temp) {
+      items[j + 1] = items[j];
       j--;
     }
 
-    list->items[j + 1] = temp;
+    items[j + 1] = temp;
   }
 
   return NIL_VAL;
 }
 
 // partition for quicksort
-static int partition(Value* arr, int left, int right) {
-  Value pivot = arr[right];
+static int partition(double* arr, int left, int right) {
+  double pivot = arr[right];
   int i = left - 1;
 
   for (int j = left; j <= right - 1; j++) {
-    if (AS_NUMBER(arr[j]) <= AS_NUMBER(pivot)) {
+    if (arr[j] <= pivot) {
       i++;
-      Value temp = arr[i];
+      double temp = arr[i];
       arr[i] = arr[j];
       arr[j] = temp;
     }
   }
 
-  Value temp = arr[i + 1];
+  double temp = arr[i + 1];
   arr[i + 1] = arr[right];
   arr[right] = temp;
 
@@ -81,7 +152,7 @@ static int partition(Value* arr, int left, int right) {
 }
 
 // quicksort function
-static void quickSort(Value* items, int left, int right) {
+static void quickSort(double* items, int left, int right) {
   if (left < right) {
     int pivotIndex = partition(items, left, right);
     quickSort(items, left, pivotIndex - 1);
@@ -97,31 +168,333 @@ static Value quickSortNative(int argCount, Value* args) {
     return NIL_VAL;
   }
 
+  if (!numberList(args[0], "sorts.Quick")) return NIL_VAL;
   ObjList* list = AS_LIST(args[0]);
 
-  quickSort(list->items, 0, list->count - 1);
+  quickSort(list->numbers, 0, list->count - 1);
 
   return NIL_VAL;
 }
 
-/* Finally we create the module */
-void createSortsModule() 
-{
-  // name of the overall module
-  ObjString* name = copyString("sorts", 5);
-  push(OBJ_VAL(name));
+/* Lists of numbers are sorted unboxed and lists of strings by their
+ * bytes, anything else reports the first item of the wrong type. Sets
+ * strings when it is a list of strings */
+static bool sortableList(Value value, const char* name, bool* strings) {
+  if (!IS_LIST(value)) {
+    runtimeError("%s: argument is not a list", name);
+    return false;
+  }
+
+  ObjList* list = AS_LIST(value);
+  *strings = false;
+  if (specialiseList(list)) return true;
+
+  bool number = IS_NUMBER(list->items[0]);
+  for (int i = 0; i < list->count; i++) {
+    if (number != IS_NUMBER(list->items[i]) ||
+        (!number && !IS_STRING(list->items[i]))) {
+      runtimeError("%s: can only sort numbers or strings, item at index=%d "
+                   "is not a %s", name, i, number ? "number" : "string");
+      return false;
+    }
+  }
+
+  *strings = true;
+  return true;
+}
+
+/* NaN does not compare with anything so it goes at the end, returns how
+ * many numbers are left to sort */
+static int moveNaNsToEnd(double* numbers, int count) {
+  int end = count;
+  for (int i = 0; i < end;) {
+    if (isnan(numbers[i])) {
+      double temp = numbers[i];
+      numbers[i] = numbers[--end];
+      numbers[end] = temp;
+    } else {
+      i++;
+    }
+  }
+  return end;
+}
+
+// sorts.Sort(list), pattern-defeating quicksort
+static Value pdqSortNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'sorts.Sort'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  bool strings;
+  if (!sortableList(args[0], "sorts.Sort", &strings)) return NIL_VAL;
+  ObjList* list = AS_LIST(args[0]);
+
+  if (strings) {
+    strings_pdqSort(list->items, list->count);
+  } else {
+    numbers_pdqSort(list->numbers, moveNaNsToEnd(list->numbers, list->count));
+  }
+
+  return NIL_VAL;
+}
+
+// sorts.Stable(list), equal items keep their order
+static Value timSortNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'sorts.Stable'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  bool strings;
+  if (!sortableList(args[0], "sorts.Stable", &strings)) return NIL_VAL;
+  ObjList* list = AS_LIST(args[0]);
+
+  if (strings) {
+    strings_timSort(list->items, list->count);
+  } else {
+    // NaNs are all alike so moving them does not break stability for the
+    // numbers that are left
+    int count = 0;
+    for (int i = 0; i < list->count; i++) {
+      if (!isnan(list->numbers[i])) list->numbers[count++] = list->numbers[i];
+    }
+    for (int i = count; i < list->count; i++) list->numbers[i] = NAN;
+
+    numbers_timSort(list->numbers, count);
+  }
+
+  return NIL_VAL;
+}
+
+// sorts.SortBy(list, fn), stable sort on the key fn returns for each item
+static Value sortByNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'sorts.SortBy'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!IS_LIST(args[0])) {
+    runtimeError("sorts.SortBy: argument is not a list");
+    return NIL_VAL;
+  }
+
+  if (!isCallable(args[1])) {
+    runtimeError("sorts.SortBy: key must be a function");
+    return NIL_VAL;
+  }
+
+  ObjList* list = AS_LIST(args[0]);
+  int count = list->count;
+  if (count == 0) return NIL_VAL;
+
+  // each key is computed once, not on every comparison
+  KeyedItem* keyed = ALLOCATE(KeyedItem, count);
+  for (int i = 0; i < count; i++) {
+    keyed[i].item = indexFromList(list, i);
+    if (!vmCall(args[1], &keyed[i].item, 1, &keyed[i].key)) {
+      FREE_ARRAY(KeyedItem, keyed, count);
+      return NIL_VAL;
+    }
+
+    // long concatenations are ropes until something needs their chars
+    keyed[i].key = flattenValue(keyed[i].key);
+    bool number = IS_NUMBER(keyed[0].key);
+    if (number != IS_NUMBER(keyed[i].key) ||
+        (!number && !IS_STRING(keyed[i].key))) {
+      runtimeError("sorts.SortBy: keys must all be numbers or all strings, "
+                   "key at index=%d is not a %s", i, number ? "number" : "string");
+      FREE_ARRAY(KeyedItem, keyed, count);
+      return NIL_VAL;
+    }
+  }
+
+  if (list->count != count) {
+    runtimeError("sorts.SortBy: list changed while computing keys");
+    FREE_ARRAY(KeyedItem, keyed, count);
+    return NIL_VAL;
+  }
+
+  if (IS_STRING(keyed[0].key)) {
+    stringKeys_timSort(keyed, count);
+  } else {
+    // items with a NaN key keep their order at the end, like sorts.Stable
+    KeyedItem* nans = ALLOCATE(KeyedItem, count);
+    int sorted = 0, skipped = 0;
+    for (int i = 0; i < count; i++) {
+      if (isnan(AS_NUMBER(keyed[i].key))) nans[skipped++] = keyed[i];
+      else keyed[sorted++] = keyed[i];
+    }
+    memcpy(keyed + sorted, nans, sizeof(KeyedItem) * skipped);
+    FREE_ARRAY(KeyedItem, nans, count);
+
+    numberKeys_timSort(keyed, sorted);
+  }
+
+  for (int i = 0; i < count; i++) storeToList(list, i, keyed[i].item);
+
+  FREE_ARRAY(KeyedItem, keyed, count);
+  return NIL_VAL;
+}
+
+/* Lists shorter than this are not worth starting threads for */
+#define PARALLEL_SORT_MIN 100000
+#define PARALLEL_SORT_MAX_THREADS 64
+
+/* One piece of work for a sorting thread. Threads must not allocate, so
+ * the scratch space is set up before any of them start */
+typedef struct {
+  double* source;
+  double* dest;
+  int begin;
+  int middle;
+  int end;
+} SortTask;
+
+static void* sortChunk(void* arg) {
+  SortTask* task = arg;
+  numbers_pdqSort(task->source + task->begin, task->end - task->begin);
+  return NULL;
+}
+
+/* Merge source[begin, middle) and source[middle, end) into dest */
+static void* mergeChunks(void* arg) {
+  SortTask* task = arg;
+  const double* source = task->source;
+  double* dest = task->dest;
+  int left = task->begin;
+  int right = task->middle;
+  int out = task->begin;
+
+  while (left < task->middle && right < task->end) {
+    if (source[right] < source[left]) dest[out++] = source[right++];
+    else dest[out++] = source[left++];
+  }
+  while (left < task->middle) dest[out++] = source[left++];
+  while (right < task->end) dest[out++] = source[right++];
+  return NULL;
+}
+
+/* Run every task, one on this thread and the rest on threads of their
+ * own. A task whose thread cannot be started is run here instead */
+static void runTasks(void* (*work)(void*), SortTask* tasks, int count) {
+  pthread_t threads[PARALLEL_SORT_MAX_THREADS];
+  bool started[PARALLEL_SORT_MAX_THREADS];
+
+  for (int i = 1; i < count; i++) {
+    started[i] = pthread_create(&threads[i], NULL, work, &tasks[i]) == 0;
+    if (!started[i]) work(&tasks[i]);
+  }
+
+  work(&tasks[0]);
+
+  for (int i = 1; i < count; i++) {
+    if (started[i]) pthread_join(threads[i], NULL);
+  }
+}
+
+/* Sort chunks of the list on separate threads, then merge neighbouring
+ * chunks in pairs until one is left, also in parallel */
+static void parallelSort(double* numbers, int count, int threads) {
+  double* scratch = ALLOCATE(double, count);
+  SortTask tasks[PARALLEL_SORT_MAX_THREADS];
+  int bounds[PARALLEL_SORT_MAX_THREADS + 1];
+
+  for (int i = 0; i <= threads; i++) {
+    bounds[i] = (int)((long long)count * i / threads);
+  }
+
+  for (int i = 0; i < threads; i++) {
+    tasks[i] = (SortTask){numbers, NULL, bounds[i], bounds[i], bounds[i + 1]};
+  }
+  runTasks(sortChunk, tasks, threads);
+
+  double* source = numbers;
+  double* dest = scratch;
+  int chunks = threads;
+
+  while (chunks > 1) {
+    int pairs = chunks / 2;
+    for (int i = 0; i < pairs; i++) {
+      tasks[i] = (SortTask){source, dest, bounds[2 * i], bounds[2 * i + 1],
+                            bounds[2 * i + 2]};
+    }
+    runTasks(mergeChunks, tasks, pairs);
+
+    // an odd chunk out is carried over as it is
+    if (chunks % 2 == 1) {
+      int begin = bounds[chunks - 1];
+      memcpy(dest + begin, source + begin,
+             sizeof(double) * (bounds[chunks] - begin));
+    }
+
+    for (int i = 0; i <= pairs; i++) bounds[i] = bounds[2 * i];
+    if (chunks % 2 == 1) bounds[++pairs] = bounds[chunks];
+    chunks = pairs;
+
+    double* swap = source;
+    source = dest;
+    dest = swap;
+  }
+
+  if (source != numbers) memcpy(numbers, source, sizeof(double) * count);
+  FREE_ARRAY(double, scratch, count);
+}
+
+// sorts.Parallel(list, threads), threads defaults to the number of cpus
+static Value parallelSortNative(int argCount, Value* args) {
+  if (argCount != 1 && argCount != 2) {
+    runtimeError("wrong number of arguments to 'sorts.Parallel'. got=%d, want=1 or 2", argCount);
+    return NIL_VAL;
+  }
 
+  int threads;
+  if (argCount == 2) {
+    if (!IS_NUMBER(args[1]) || !(AS_NUMBER(args[1]) >= 1)) {
+      runtimeError("sorts.Parallel: thread count must be a positive number");
+      return NIL_VAL;
+    }
+    // clamp before converting, a huge count does not fit in an int
+    double requested = AS_NUMBER(args[1]);
+    threads = requested > PARALLEL_SORT_MAX_THREADS ? PARALLEL_SORT_MAX_THREADS
+                                                    : (int)requested;
+  } else {
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (threads > PARALLEL_SORT_MAX_THREADS) threads = PARALLEL_SORT_MAX_THREADS;
 
-  // we use the name to create the object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
+  bool strings;
+  if (!sortableList(args[0], "sorts.Parallel", &strings)) return NIL_VAL;
+  ObjList* list = AS_LIST(args[0]);
 
+  if (strings) {
+    strings_pdqSort(list->items, list->count);
+    return NIL_VAL;
+  }
+
+  int count = moveNaNsToEnd(list->numbers, list->count);
+  if (count < PARALLEL_SORT_MIN || threads < 2) {
+    numbers_pdqSort(list->numbers, count);
+  } else {
+    parallelSort(list->numbers, count, threads);
+  }
+
+  return NIL_VAL;
+}
+
+/* Finally we create the module */
+static void loadSortsModule(ObjNativeClass* klass)
+{
   defineModuleMethod(klass, "Bubble", bubbleSortNative);
   defineModuleMethod(klass, "Quick", quickSortNative);
-  defineModuleMethod(klass, "Sort", quickSortNative);
+  defineModuleMethod(klass, "Sort", pdqSortNative);
+  defineModuleMethod(klass, "Stable", timSortNative);
+  defineModuleMethod(klass, "SortBy", sortByNative);
+  defineModuleMethod(klass, "Parallel", parallelSortNative);
   defineModuleMethod(klass, "Insertion", insertionSortNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createSortsModule()
+{
+  defineModule("sorts", loadSortsModule);
 }
@@ -0,0 +1,228 @@
+#include <math.h>
+
+#include "stream.h"
+#include "../include/stream.h"
+
+/* Any argument for-in can walk is wrapped in a source stream. Reports an
+ * error if it can not be streamed or the stream was already used */
+static ObjStream* streamArgument(Value value, const char* name) {
+  ObjStream* stream = streamFromValue(value);
+  if (stream == NULL) {
+    runtimeError("stream.%s: argument can not be streamed", name);
+    return NULL;
+  }
+
+  return claimStream(stream) ? stream : NULL;
+}
+
+/* Add a stage pulling from the first argument */
+static Value addStage(StreamStage stage, int argCount, Value* args,
+                      const char* name) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'stream.%s'. got=%d, want=2",
+                 name, argCount);
+    return NIL_VAL;
+  }
+
+  bool callback = stage == STREAM_MAP || stage == STREAM_FILTER;
+  if (callback && !isCallable(args[1])) {
+    runtimeError("stream.%s: second argument must be a function", name);
+    return NIL_VAL;
+  }
+
+  if (!callback && (!IS_NUMBER(args[1]) || AS_NUMBER(args[1]) < 0 ||
+                    (stage == STREAM_CHUNK && AS_NUMBER(args[1]) < 1))) {
+    runtimeError("stream.%s: second argument must be a %s number", name,
+                 stage == STREAM_CHUNK ? "positive" : "non-negative");
+    return NIL_VAL;
+  }
+
+  ObjStream* source = streamArgument(args[0], name);
+  if (source == NULL) return NIL_VAL;
+
+  ObjStream* stream = newStream(stage);
+  stream->source = source;
+  if (callback) {
+    stream->fn = args[1];
+  } else {
+    stream->limit = AS_NUMBER(args[1]);
+  }
+
+  return OBJ_VAL(stream);
+}
+
+// stream.Of(value), a stream over a list, map, set or Float64 array
+static Value ofNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'stream.Of'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  ObjStream* stream = streamFromValue(args[0]);
+  if (stream == NULL) {
+    runtimeError("stream.Of: argument can not be streamed");
+    return NIL_VAL;
+  }
+
+  return OBJ_VAL(stream);
+}
+
+// stream.Range(start[, end[, step]]), numbers up to and including end,
+// with no end it never stops
+static Value rangeNative(int argCount, Value* args) {
+  if (argCount < 1 || argCount > 3) {
+    runtimeError("wrong number of arguments to 'stream.Range'. got=%d, want=1-3", argCount);
+    return NIL_VAL;
+  }
+
+  for (int i = 0; i < argCount; i++) {
+    if (!IS_NUMBER(args[i])) {
+      runtimeError("stream.Range: arguments must be numbers");
+      return NIL_VAL;
+    }
+  }
+
+  ObjStream* stream = newStream(STREAM_RANGE);
+  stream->next = AS_NUMBER(args[0]);
+  stream->end = argCount > 1 ? AS_NUMBER(args[1]) : INFINITY;
+  stream->step = argCount > 2 ? AS_NUMBER(args[2]) : 1;
+
+  if (stream->step == 0) {
+    runtimeError("stream.Range: step can not be 0");
+    return NIL_VAL;
+  }
+
+  return OBJ_VAL(stream);
+}
+
+// stream.Map(stream, fn)
+static Value mapNative(int argCount, Value* args) {
+  return addStage(STREAM_MAP, argCount, args, "Map");
+}
+
+// stream.Filter(stream, fn)
+static Value filterNative(int argCount, Value* args) {
+  return addStage(STREAM_FILTER, argCount, args, "Filter");
+}
+
+// stream.Take(stream, n)
+static Value takeNative(int argCount, Value* args) {
+  return addStage(STREAM_TAKE, argCount, args, "Take");
+}
+
+// stream.Skip(stream, n)
+static Value skipNative(int argCount, Value* args) {
+  return addStage(STREAM_SKIP, argCount, args, "Skip");
+}
+
+// stream.Chunk(stream, n)
+static Value chunkNative(int argCount, Value* args) {
+  return addStage(STREAM_CHUNK, argCount, args, "Chunk");
+}
+
+// stream.Collect(stream), every item in a new list
+static Value collectNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'stream.Collect'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  ObjStream* stream = streamArgument(args[0], "Collect");
+  if (stream == NULL) return NIL_VAL;
+
+  ObjList* list = newList();
+  Value item;
+  StreamResult result;
+  while ((result = nextFromStream(stream, &item)) == STREAM_ITEM) {
+    appendToList(list, item);
+  }
+
+  return result == STREAM_ERROR ? NIL_VAL : OBJ_VAL(list);
+}
+
+// stream.Sum(stream)
+static Value sumNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'stream.Sum'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  ObjStream* stream = streamArgument(args[0], "Sum");
+  if (stream == NULL) return NIL_VAL;
+
+  double sum = 0;
+  Value item;
+  StreamResult result;
+  while ((result = nextFromStream(stream, &item)) == STREAM_ITEM) {
+    if (!IS_NUMBER(item)) {
+      runtimeError("stream.Sum: can only add numbers");
+      return NIL_VAL;
+    }
+    sum += AS_NUMBER(item);
+  }
+
+  return result == STREAM_ERROR ? NIL_VAL : NUMBER_VAL(sum);
+}
+
+// stream.Count(stream)
+static Value countNative(int argCount, Value* args) {
+  if (argCount != 1) {
+    runtimeError("wrong number of arguments to 'stream.Count'. got=%d, want=1", argCount);
+    return NIL_VAL;
+  }
+
+  ObjStream* stream = streamArgument(args[0], "Count");
+  if (stream == NULL) return NIL_VAL;
+
+  int count = 0;
+  Value item;
+  StreamResult result;
+  while ((result = nextFromStream(stream, &item)) == STREAM_ITEM) {
+    count++;
+  }
+
+  return result == STREAM_ERROR ? NIL_VAL : NUMBER_VAL(count);
+}
+
+// stream.Each(stream, fn)
+static Value eachNative(int argCount, Value* args) {
+  if (argCount != 2) {
+    runtimeError("wrong number of arguments to 'stream.Each'. got=%d, want=2", argCount);
+    return NIL_VAL;
+  }
+
+  if (!isCallable(args[1])) {
+    runtimeError("stream.Each: second argument must be a function");
+    return NIL_VAL;
+  }
+
+  ObjStream* stream = streamArgument(args[0], "Each");
+  if (stream == NULL) return NIL_VAL;
+
+  Value item, ignored;
+  while (nextFromStream(stream, &item) == STREAM_ITEM) {
+    if (!vmCall(args[1], &item, 1, &ignored)) break;
+  }
+
+  return NIL_VAL;
+}
+
+static void loadStreamModule(ObjNativeClass* klass)
+{
+  defineModuleMethod(klass, "Of", ofNative);
+  defineModuleMethod(klass, "Range", rangeNative);
+  defineModuleMethod(klass, "Map", mapNative);
+  defineModuleMethod(klass, "Filter", filterNative);
+  defineModuleMethod(klass, "Take", takeNative);
+  defineModuleMethod(klass, "Skip", skipNative);
+  defineModuleMethod(klass, "Chunk", chunkNative);
+  defineModuleMethod(klass, "Collect", collectNative);
+  defineModuleMethod(klass, "Sum", sumNative);
+  defineModuleMethod(klass, "Count", countNative);
+  defineModuleMethod(klass, "Each", eachNative);
+}
+
+void createStreamModule()
+{
+  defineModule("stream", loadStreamModule);
+}
@@ -0,0 +1,9 @@
+#ifndef mt_module_stream
+#define mt_module_stream
+
+#include "modules.h"
+#include "../include/vm.h"
+
+void createStreamModule();
+
+#endif  // mt_module_stream
@@ -77,11 +77,8 @@ static Value substringNative(int argCount, Value* args) {
     runtimeError("start and end arguments to 'Substring' must be within the bounds of the string");
   }
 
-  char* result = malloc(sizeof(char) * (end - start + 2));
-  memcpy(result, AS_CSTRING(args[0]) + start, end - start + 1);
-  result[end - start + 1] = '\0';
-
-  return OBJ_VAL(copyString(result, end - start + 1));
+  // long substrings share the characters of the string
+  return OBJ_VAL(sliceString(AS_STRING(args[0]), start, end - start + 1));
 }
 
 // native indexOf method
@@ -295,14 +292,8 @@ static Value toStringNative(int argCount, Value* args) {
 }
 
 
-void createStringsModule() {
-  ObjString* name = copyString("strings", 7);
-  push(OBJ_VAL(name));
-
-  // now create the runtime object
-  ObjNativeClass *klass = newNativeClass(name);
-  push(OBJ_VAL(name));
-
+static void loadStringsModule(ObjNativeClass* klass)
+{
   defineModuleMethod(klass, "Concat", concatNative);
   defineModuleMethod(klass, "Len", strlenNative);
   defineModuleMethod(klass, "Substring", substringNative);
@@ -313,8 +304,9 @@ void createStringsModule() {
   defineModuleMethod(klass, "Trim", trimNative);
   defineModuleMethod(klass, "Split", splitNative);
   defineModuleMethod(klass, "ToString", toStringNative);
+}
 
-  tableSet(&vm.globals, name, OBJ_VAL(klass));
-  pop();
-  pop();
+void createStringsModule()
+{
+  defineModule("strings", loadStringsModule);
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/compiler.h"
+#include "../include/error.h"
+#include "../include/mt.h"
+#include "../include/vm.h"
+
+/* The handle is the global vm, scripts are their top level closures */
+static bool created = false;
+
+MtVM* mtNewVM(const MtConfig* config)
+{
+  if (created) return NULL;
+  created = true;
+
+  initVM("");
+  if (config != NULL)
+  {
+    vm.writeOutput = config->output;
+    vm.writeError = config->error;
+    vm.writeData = config->data;
+  }
+  return (MtVM*)&vm;
+}
+
+void mtFreeVM(MtVM* handle)
+{
+  if (handle == NULL) return;
+
+  freeVM();
+  vm.writeOutput = NULL;
+  vm.writeError = NULL;
+  vm.writeData = NULL;
+  created = false;
+}
+
+MtScript* mtCompile(MtVM* handle, const char* source, const char* name)
+{
+  /* keep the name for use statements run later on */
+  ObjString* path = copyString(name, (int)strlen(name));
+  CURRENT_FILE_PATH = path->chars;
+  vm.fileName = path->chars;
+
+  ObjFunction* function = compile(source, false);
+  if (function == NULL) return NULL;
+
+  return (MtScript*)newClosure(function);
+}
+
+MtResult mtRun(MtVM* handle, MtScript* script)
+{
+  Value result;
+  if (!vmCall(OBJ_VAL((ObjClosure*)script), NULL, 0, &result))
+    return MT_RUNTIME_ERROR;
+  return MT_OK;
+}
+
+MtResult mtCall(MtVM* handle, const char* name, int argCount)
+{
+  if (argCount < 0 || vm.stackTop - vm.stack < argCount)
+  {
+    runtimeError("Not enough values on the stack to call '%s'.", name);
+    return MT_RUNTIME_ERROR;
+  }
+
+  Value callee;
+  if (!mtGetGlobal(handle, name, &callee) || !isCallable(callee))
+  {
+    runtimeError("'%s' is not a function.", name);
+    return MT_RUNTIME_ERROR;
+  }
+
+  Value* args = vm.stackTop - argCount;
+  Value result;
+  if (!vmCall(callee, args, argCount, &result))
+    return MT_RUNTIME_ERROR;
+
+  vm.stackTop = args;
+  push(result);
+  return MT_OK;
+}
+
+void mtPush(MtVM* handle, MtValue value)
+{
+  push(value);
+}
+
+MtValue mtPop(MtVM* handle)
+{
+  if (vm.stackTop == vm.stack) return NIL_VAL;
+  return pop();
+}
+
+void mtDefineNative(MtVM* handle, const char* name, MtNativeFn function)
+{
+  /* calls compiled for a module are looked up again once it is replaced */
+  if (copyString(name, (int)strlen(name))->module)
+    vm.modulesRebound = true;
+
+  defineNative(name, function);
+}
+
+void mtSetGlobal(MtVM* handle, const char* name, MtValue value)
+{
+  ObjString* key = copyString(name, (int)strlen(name));
+  if (key->module)
+    vm.modulesRebound = true;
+
+  tableSet(&vm.globals, key, value);
+}
+
+bool mtGetGlobal(MtVM* handle, const char* name, MtValue* value)
+{
+  return tableGet(&vm.globals, copyString(name, (int)strlen(name)), value);
+}
+
+void mtError(const char* format, ...)
+{
+  char message[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+
+  runtimeError("%s", message);
+}
+
+MtValue mtNil(void)
+{
+  return NIL_VAL;
+}
+
+MtValue mtBool(bool boolean)
+{
+  return BOOL_VAL(boolean);
+}
+
+MtValue mtNumber(double number)
+{
+  return NUMBER_VAL(number);
+}
+
+MtValue mtString(MtVM* handle, const char* chars, int length)
+{
+  return OBJ_VAL(copyString(chars, length));
+}
+
+bool mtIsNumber(MtValue value)
+{
+  return IS_NUMBER(value);
+}
+
+bool mtIsString(MtValue value)
+{
+  return isStringLike(value);
+}
+
+double mtAsNumber(MtValue value)
+{
+  return IS_NUMBER(value) ? AS_NUMBER(value) : 0;
+}
+
+bool mtAsBool(MtValue value)
+{
+  return !isFalsey(value);
+}
+
+const char* mtAsString(MtValue value, int* length)
+{
+  if (!isStringLike(value)) return NULL;
+
+  ObjString* string = AS_STRING(flattenValue(value));
+  if (length != NULL) *length = string->length;
+  return string->chars;
+}
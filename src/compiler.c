@@ -4,6 +4,8 @@
 #include "../include/memory.h"
 #include "../include/object.h"
 #include "../include/scanner.h"
+#include "../include/vm.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,6 +86,16 @@ typedef struct Compiler {
   int localCount;
   Upvalue upvalues[UINT8_COUNT];
   int scopeDepth;
+
+  /* Used to fuse a trailing comparison into a conditional branch */
+  int compareEnd;
+  int compareLength;
+  uint8_t compareJump;
+  int jumpTarget;
+
+  /* Used to turn calls on a built-in module into intrinsics */
+  int globalEnd;
+  uint8_t globalName;
 } Compiler;
 
 typedef struct ClassCompiler {
@@ -239,6 +251,18 @@ static uint8_t makeConstant(Value value) {
   return (uint8_t)constant;
 }
 
+/* Reuse the constant if the chunk already holds this object. Names and
+ * resolved natives repeat a lot in one chunk */
+static uint8_t objectConstant(Obj *object) {
+  ValueArray *constants = &currentChunk()->constants;
+  for (int i = 0; i < constants->count && i <= UINT8_MAX; i++) {
+    if (IS_OBJ(constants->values[i]) && AS_OBJ(constants->values[i]) == object)
+      return (uint8_t)i;
+  }
+
+  return makeConstant(OBJ_VAL(object));
+}
+
 /* Another wrapper for emit Bytes */
 static void emitConstant(Value value) {
   emitBytes(OP_CONSTANT, makeConstant(value));
@@ -256,6 +280,33 @@ static void patchJump(int offset) {
 
   currentChunk()->code[offset] = (jump >> 8) & 0xff;
   currentChunk()->code[offset + 1] = jump & 0xff;
+  current->jumpTarget = currentChunk()->count;
+}
+
+/* Remember the comparison just emitted so a condition can fuse it */
+static void markComparison(int length, uint8_t jump) {
+  current->compareEnd = currentChunk()->count;
+  current->compareLength = length;
+  current->compareJump = jump;
+}
+
+/* Emits the exit branch of a condition. If the condition ended in a
+ * numeric comparison it is replaced with a compare-and-branch opcode
+ * that leaves no bool on the stack, in which case false is returned and
+ * the caller must not pop the condition on either path. */
+static bool emitConditionJump(int *jump) {
+  Chunk *chunk = currentChunk();
+
+  if (current->compareEnd == chunk->count &&
+      current->jumpTarget != chunk->count) {
+    chunk->count -= current->compareLength;
+    current->compareEnd = -1;
+    *jump = emitJump(current->compareJump);
+    return false;
+  }
+
+  *jump = emitJump(OP_JUMP_IF_FALSE);
+  return true;
 }
 
 /* Initialise compiler and set to current */
@@ -265,6 +316,11 @@ static void initCompiler(Compiler *compiler, FunctionType type) {
   compiler->type = type;
   compiler->localCount = 0;
   compiler->scopeDepth = 0;
+  compiler->compareEnd = -1;
+  compiler->compareLength = 0;
+  compiler->compareJump = OP_JUMP_IF_FALSE;
+  compiler->jumpTarget = -1;
+  compiler->globalEnd = -1;
   compiler->function = newFunction();
   current = compiler;
 
@@ -389,15 +445,19 @@ static void binary(bool canAssign) {
     break;
   case TOKEN_GREATER:
     emitByte(OP_GREATER);
+    markComparison(1, OP_JUMP_IF_NOT_GREATER);
     break;
   case TOKEN_GREATER_EQUAL:
     emitBytes(OP_LESS, OP_NOT);
+    markComparison(2, OP_JUMP_IF_LESS);
     break;
   case TOKEN_LESS:
     emitByte(OP_LESS);
+    markComparison(1, OP_JUMP_IF_NOT_LESS);
     break;
   case TOKEN_LESS_EQUAL:
     emitBytes(OP_GREATER, OP_NOT);
+    markComparison(2, OP_JUMP_IF_GREATER);
     break;
   case TOKEN_PLUS:
     emitByte(OP_ADD);
@@ -417,6 +477,9 @@ static void binary(bool canAssign) {
   case TOKEN_PERCENT:
     emitByte(OP_MOD);
     break;
+  case TOKEN_IN:
+    emitByte(OP_IN);
+    break;
   default:
     return; /* Unreachable. */
   }
@@ -428,21 +491,116 @@ static void call(bool canAssign) {
   emitBytes(OP_CALL, argCount);
 }
 
+/* math calls with their own opcodes */
+typedef struct {
+  const char *name;
+  int argCount;
+  OpCode op;
+} Intrinsic;
+
+static const Intrinsic mathIntrinsics[] = {
+    {"Abs", 1, OP_MATH_ABS}, {"Cos", 1, OP_MATH_COS},
+    {"Pow", 2, OP_MATH_POW}, {"Sin", 1, OP_MATH_SIN},
+    {"Sqrt", 1, OP_MATH_SQRT},
+};
+
+/* The built-in module the global constant names, or NULL if it has been
+ * rebound. The vm guards against it being rebound after compiling */
+static ObjNativeClass *builtinModule(uint8_t global) {
+  ObjString *name = AS_STRING(currentChunk()->constants.values[global]);
+  Value value;
+
+  if (!name->module || vm.modulesRebound ||
+      !tableGet(&vm.globals, name, &value) || !IS_NATIVE_CLASS(value))
+    return NULL;
+
+  return AS_NATIVE_CLASS(value);
+}
+
+/* The intrinsic for global.method(argCount), or -1 */
+static int findIntrinsic(uint8_t global, Token *method, int argCount) {
+  ObjNativeClass *module = builtinModule(global);
+
+  if (module == NULL || module->name->length != 4 ||
+      memcmp(module->name->chars, "math", 4) != 0)
+    return -1;
+
+  for (int i = 0; i < (int)(sizeof(mathIntrinsics) / sizeof(Intrinsic)); i++) {
+    const Intrinsic *intrinsic = &mathIntrinsics[i];
+    if (intrinsic->argCount == argCount &&
+        (int)strlen(intrinsic->name) == method->length &&
+        memcmp(intrinsic->name, method->start, method->length) == 0)
+      return intrinsic->op;
+  }
+
+  return -1;
+}
+
+/* The constant holding the native for global.method, or -1 */
+static int findModuleMethod(uint8_t global, uint8_t method) {
+  ObjNativeClass *module = builtinModule(global);
+  Value native;
+
+  if (module == NULL ||
+      !tableGet(nativeClassMethods(module),
+                AS_STRING(currentChunk()->constants.values[method]), &native))
+    return -1;
+
+  return objectConstant(AS_OBJ(native));
+}
+
+/* Drop the global get ending at end, moving the code after it down */
+static void removeGlobalGet(int end) {
+  Chunk *chunk = currentChunk();
+  int length = chunk->count - end;
+
+  memmove(chunk->code + end - 2, chunk->code + end, length);
+  memmove(chunk->lines + end - 2, chunk->lines + end, sizeof(int) * length);
+  chunk->count -= 2;
+
+  if (current->compareEnd >= end) current->compareEnd -= 2;
+  if (current->jumpTarget >= end) current->jumpTarget -= 2;
+}
+
 /* Parse a get or set expression of an instance of a class */
 static void dot(bool canAssign) {
   consume(TOKEN_IDENTIFIER,
           "Expected property name after '.', make sure you "
           "are using it on a class.",
           E_COMPILER_EXPECTED_PROPERTY_NAME);
+  Token method = parser.previous;
   uint8_t name = identifierConstant(&parser.previous);
 
   if (canAssign && match(TOKEN_EQUAL)) {
     expression();
     emitBytes(OP_SET_PROPERTY, name);
   } else if (match(TOKEN_LEFT_PAREN)) {
+    // the receiver is a global if its get was the last thing emitted and
+    // no jump lands after it, as the end of (a || math) does
+    Chunk *chunk = currentChunk();
+    int receiverEnd = chunk->count;
+    uint8_t receiver = current->globalName;
+    bool global = current->globalEnd == receiverEnd &&
+                  current->jumpTarget != receiverEnd &&
+                  chunk->code[receiverEnd - 2] == OP_GET_GLOBAL &&
+                  chunk->code[receiverEnd - 1] == receiver;
+
     uint8_t argCount = argumentList();
-    emitBytes(OP_INVOKE, name);
-    emitByte(argCount);
+    int intrinsic = global ? findIntrinsic(receiver, &method, argCount) : -1;
+    int native = global && intrinsic == -1 ? findModuleMethod(receiver, name)
+                                           : -1;
+
+    if (intrinsic != -1) {
+      removeGlobalGet(receiverEnd);
+      emitByte((uint8_t)intrinsic);
+    } else if (native != -1) {
+      removeGlobalGet(receiverEnd);
+      emitBytes(OP_INVOKE_NATIVE, (uint8_t)native);
+      emitByte(argCount);
+    } else {
+      emitBytes(OP_INVOKE, name);
+      emitByte(argCount);
+    }
   } else {
     emitBytes(OP_GET_PROPERTY, name);
   }
@@ -554,6 +712,36 @@ static void list(bool canAssign) {
   return;
 }
 
+/* Parse a map literal */
+static void map(bool canAssign) {
+  int pairCount = 0;
+
+  if (!check(TOKEN_RIGHT_BRACE)) {
+    do {
+      if (check(TOKEN_RIGHT_BRACE)) {
+        // Trailing comma case
+        break;
+      }
+
+      parsePrecedence(PREC_OR);
+      consume(TOKEN_COLON, "Expected ':' after map key.",
+              E_COMPILER_EXPECTED_COLON);
+      parsePrecedence(PREC_OR);
+
+      if (pairCount == UINT8_COUNT - 1) {
+        error(E_COMPILER_MAP_TOO_LARGE,
+              "Cannot have more than 255 entries in a map literal.");
+      }
+      pairCount++;
+    } while (match(TOKEN_COMMA));
+  }
+
+  consume(TOKEN_RIGHT_BRACE, "Expected '}' after map literal.",
+          E_COMPILER_EXPECTED_RBRACE);
+
+  emitBytes(OP_BUILD_MAP, pairCount);
+}
+
 /* Parse a subscript */
 static void subscript(bool canAssign) {
   parsePrecedence(PREC_OR);
@@ -659,6 +847,11 @@ static void namedVariable(Token name, bool canAssign) {
     SHORT_HAND(OP_MOD);
   } else {
     emitBytes(getOp, (uint8_t)arg);
+
+    if (getOp == OP_GET_GLOBAL) {
+      current->globalEnd = currentChunk()->count;
+      current->globalName = (uint8_t)arg;
+    }
   }
 }
 
@@ -767,7 +960,8 @@ ParseRule rules[] = {
     [TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
     [TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
     [TOKEN_IF] = {NULL, NULL, PREC_NONE},
-    [TOKEN_LEFT_BRACE] = {NULL, NULL, PREC_NONE},
+    [TOKEN_IN] = {NULL, binary, PREC_COMPARISON},
+    [TOKEN_LEFT_BRACE] = {map, NULL, PREC_NONE},
     [TOKEN_LEFT_BRACKET] = {list, subscript, PREC_SUBSCRIPT},
     [TOKEN_LEFT_PAREN] = {grouping, call, PREC_CALL},
     [TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
@@ -832,7 +1026,7 @@ static void parsePrecedence(Precedence precedence) {
 
 /* Parse identifier token */
 static uint8_t identifierConstant(Token *name) {
-  return makeConstant(OBJ_VAL(copyString(name->start, name->length)));
+  return objectConstant((Obj *)copyString(name->start, name->length));
 }
 
 /* fn to check for variable redeclaration */
@@ -1205,11 +1399,20 @@ static void letDeclaration() {
   }
 }
 
-/* Compile a use statement */
+/* Compile a use statement, use native "lib.so" loads a shared library
+ * of native modules instead of mt code. native is only the keyword when
+ * a path follows it, so use native; still reads a variable */
 static void useDeclaration() {
   // TODO add as
+  char next = peekTokenStart();
+  bool native = check(TOKEN_IDENTIFIER) && parser.current.length == 6 &&
+                memcmp(parser.current.start, "native", 6) == 0 &&
+                (next == '"' || next == '_' || isalpha((unsigned char)next));
+  if (native)
+    advance();
+
   expression();
-  emitByte(OP_USE);
+  emitByte(native ? OP_USE_NATIVE : OP_USE);
   consume(TOKEN_SEMICOLON, "Expected ';' after 'use' path",
           E_COMPILER_EXPECTED_SEMICOLON);
 }
@@ -1268,6 +1471,101 @@ static void expressionStatement() {
   emitByte(OP_POP);
 }
 
+/* A for loop of the form for (...; i < n; i += k) */
+typedef struct {
+  uint8_t slot;  // local holding the loop variable
+  uint8_t limit; // local slot or constant index of the bound
+  uint8_t step;  // constant index of the step
+  uint8_t flags; // FOR_* flags from chunk.h
+} CountedLoop;
+
+/* Check the condition compiled from start is local < local/constant */
+static bool countedCondition(int start, CountedLoop *loop) {
+  Chunk *chunk = currentChunk();
+  uint8_t *code = chunk->code + start;
+  int length = chunk->count - start;
+
+  if (length != 5 && length != 6)
+    return false;
+  if (code[0] != OP_GET_LOCAL)
+    return false;
+
+  loop->slot = code[1];
+  loop->limit = code[3];
+  loop->flags = 0;
+
+  if (code[2] == OP_CONSTANT) {
+    if (!IS_NUMBER(chunk->constants.values[code[3]]))
+      return false;
+    loop->flags |= FOR_LIMIT_CONSTANT;
+  } else if (code[2] != OP_GET_LOCAL) {
+    return false;
+  }
+
+  if (length == 5 && code[4] == OP_LESS) {
+    loop->flags |= FOR_CMP_LESS;
+  } else if (length == 5 && code[4] == OP_GREATER) {
+    loop->flags |= FOR_CMP_GREATER;
+  } else if (length == 6 && code[4] == OP_GREATER && code[5] == OP_NOT) {
+    loop->flags |= FOR_CMP_LESS_EQUAL;
+  } else if (length == 6 && code[4] == OP_LESS && code[5] == OP_NOT) {
+    loop->flags |= FOR_CMP_GREATER_EQUAL;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+/* Check the increment compiled from start is i += k or i -= k */
+static bool countedIncrement(int start, CountedLoop *loop) {
+  Chunk *chunk = currentChunk();
+  uint8_t *code = chunk->code + start;
+
+  if (chunk->count - start != 8)
+    return false;
+
+  if (code[0] != OP_GET_LOCAL || code[1] != loop->slot ||
+      code[2] != OP_CONSTANT || code[5] != OP_SET_LOCAL ||
+      code[6] != loop->slot || code[7] != OP_POP) {
+    return false;
+  }
+
+  if (!IS_NUMBER(chunk->constants.values[code[3]]))
+    return false;
+
+  if (code[4] == OP_SUBTRACT) {
+    loop->flags |= FOR_STEP_SUBTRACT;
+  } else if (code[4] != OP_ADD) {
+    return false;
+  }
+
+  loop->step = code[3];
+  return true;
+}
+
+/* Emit the entry check of a counted loop, returns the exit jump */
+static int emitForPrep(CountedLoop *loop) {
+  emitBytes(OP_FOR_PREP, loop->slot);
+  emitBytes(loop->limit, loop->flags);
+  emitBytes(0xff, 0xff);
+  return currentChunk()->count - 2;
+}
+
+/* Emit the step and backwards branch of a counted loop */
+static void emitForLoop(CountedLoop *loop, int bodyStart) {
+  emitBytes(OP_FOR_LOOP, loop->slot);
+  emitBytes(loop->limit, loop->flags);
+  emitByte(loop->step);
+
+  int offset = currentChunk()->count - bodyStart + 2;
+  if (offset > UINT16_MAX)
+    error(E_COMPILER_LOOP_BODY_TOO_LARGE, "Loop body too large.");
+
+  emitByte((offset >> 8) & 0xff);
+  emitByte(offset & 0xff);
+}
+
 /* Compiles a for statement */
 static void forStatement() {
 
@@ -1279,27 +1577,38 @@ static void forStatement() {
     advance();
     Token target = parser.previous;
 
-    declareVariable();
-    markInitialised();
-
     consume(TOKEN_IN, "Expected 'in' after variable.", E_COMPILER_EXPECTED_IN);
 
     expression();
 
+    /* hidden local for the iterator, then the loop variable */
     emitByte(OP_ITERATOR);
     addLocal(tokenEmpty());
     markInitialised();
+    uint8_t iteratorSlot = current->localCount - 1;
 
+    emitByte(OP_NIL);
+    addLocal(target);
+    markInitialised();
+
+    int surroundingStart = loopStart;
+    int surroundingDepth = loopDepth;
     loopStart = currentChunk()->count;
-    int exitJump = emitJump(OP_FOR_ITERATOR);
+    loopDepth = current->scopeDepth;
 
-    namedVariable(target, false);
-    emitByte(OP_POP);
+    emitBytes(OP_FOR_ITERATOR, iteratorSlot);
+    emitBytes(0xff, 0xff);
+    int exitJump = currentChunk()->count - 2;
 
     statement();
 
     emitLoop(loopStart);
     patchJump(exitJump);
+    patchBreakJumps();
+
+    loopStart = surroundingStart;
+    loopDepth = surroundingDepth;
+
     endScope();
   } else {
     beginScope();
@@ -1320,14 +1629,21 @@ static void forStatement() {
     loopStart = currentChunk()->count;
     loopDepth = current->scopeDepth;
 
+    int conditionStart = currentChunk()->count;
     int exitJump = -1;
+    bool popCondition = false;
+    bool counted = false;
+    CountedLoop loop = {0};
+
     if (!match(TOKEN_SEMICOLON)) {
       expression();
       consume(TOKEN_SEMICOLON, "Expected ';' after loop condition.",
               E_COMPILER_EXPECTED_SEMICOLON);
 
-      exitJump = emitJump(OP_JUMP_IF_FALSE);
-      emitByte(OP_POP);
+      counted = countedCondition(conditionStart, &loop);
+      popCondition = emitConditionJump(&exitJump);
+      if (popCondition)
+        emitByte(OP_POP);
     }
 
     if (!match(TOKEN_RIGHT_PAREN)) {
@@ -1339,18 +1655,35 @@ static void forStatement() {
       consume(TOKEN_RIGHT_PAREN, "Expected ')' after for clauses.",
               E_COMPILER_EXPECTED_RPAREN);
 
-      emitLoop(loopStart);
-      loopStart = incrementStart;
-      patchJump(bodyJump);
+      if (counted && countedIncrement(incrementStart, &loop)) {
+        /* fold condition and increment into the counted loop opcodes */
+        currentChunk()->count = conditionStart;
+        current->compareEnd = -1;
+        exitJump = emitForPrep(&loop);
+        loopStart = currentChunk()->count;
+      } else {
+        counted = false;
+        emitLoop(loopStart);
+        loopStart = incrementStart;
+        patchJump(bodyJump);
+      }
+    } else {
+      counted = false;
     }
 
     statement();
 
-    emitLoop(loopStart);
-
-    if (exitJump != -1) {
+    if (counted) {
+      emitForLoop(&loop, loopStart);
       patchJump(exitJump);
-      emitByte(OP_POP);
+    } else {
+      emitLoop(loopStart);
+
+      if (exitJump != -1) {
+        patchJump(exitJump);
+        if (popCondition)
+          emitByte(OP_POP);
+      }
     }
 
     patchBreakJumps();
@@ -1370,14 +1703,17 @@ static void ifStatement() {
   consume(TOKEN_RIGHT_PAREN, "Expected ')' after condition.",
           E_COMPILER_EXPECTED_RPAREN);
 
-  int thenJump = emitJump(OP_JUMP_IF_FALSE);
-  emitByte(OP_POP);
+  int thenJump;
+  bool popCondition = emitConditionJump(&thenJump);
+  if (popCondition)
+    emitByte(OP_POP);
   statement();
 
   int elseJump = emitJump(OP_JUMP);
 
   patchJump(thenJump);
-  emitByte(OP_POP);
+  if (popCondition)
+    emitByte(OP_POP);
 
   if (match(TOKEN_ELSE))
     statement();
@@ -1508,15 +1844,18 @@ static void whileStatement() {
   consume(TOKEN_RIGHT_PAREN, "Expected ')' after condition.",
           E_COMPILER_EXPECTED_RPAREN);
 
-  int exitJump = emitJump(OP_JUMP_IF_FALSE);
+  int exitJump;
+  bool popCondition = emitConditionJump(&exitJump);
 
-  emitByte(OP_POP);
+  if (popCondition)
+    emitByte(OP_POP);
   statement();
 
   emitLoop(loopStart);
 
   patchJump(exitJump);
-  emitByte(OP_POP);
+  if (popCondition)
+    emitByte(OP_POP);
 
   patchBreakJumps();
 
@@ -55,6 +55,32 @@ static int jumpInstruction(const char *name, int sign, Chunk *chunk,
   return offset + 3;
 }
 
+/* Dissassemble the counted loop instructions */
+static int forInstruction(const char *name, int sign, Chunk *chunk,
+    int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint8_t limit = chunk->code[offset + 2];
+  uint8_t flags = chunk->code[offset + 3];
+  int length = sign > 0 ? 6 : 7;
+
+  uint16_t jump = (uint16_t)(chunk->code[offset + length - 2] << 8);
+  jump |= chunk->code[offset + length - 1];
+
+  printf("%-16s %4d %s%d %02x -> %d\n", name, slot,
+         (flags & FOR_LIMIT_CONSTANT) ? "k" : "", limit, flags,
+         offset + length + sign * jump);
+  return offset + length;
+}
+
+/* Dissassemble a for in step, the iterator slot then the exit jump */
+static int iteratorInstruction(const char *name, Chunk *chunk, int offset) {
+  uint8_t slot = chunk->code[offset + 1];
+  uint16_t jump = (uint16_t)(chunk->code[offset + 2] << 8);
+  jump |= chunk->code[offset + 3];
+  printf("%-16s %4d -> %d\n", name, slot, offset + 4 + jump);
+  return offset + 4;
+}
+
 /* Subroutine used by disassembleChunk */
 int disassembleInstruction(Chunk *chunk, int offset) {
   printf("%04d ", offset);
@@ -73,6 +99,8 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       return simpleInstruction("OP_NIL", offset);
     case OP_BUILD_LIST:
       return simpleInstruction("OP_BUILD_LIST", offset);
+    case OP_BUILD_MAP:
+      return byteInstruction("OP_BUILD_MAP", chunk, offset);
     case OP_DEFER:
       return simpleInstruction("OP_DEFER", offset);
     case OP_GENERATE_LIST:
@@ -115,6 +143,16 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       return simpleInstruction("OP_NOT", offset);
     case OP_POW:
       return simpleInstruction("OP_POW", offset);
+    case OP_MATH_ABS:
+      return simpleInstruction("OP_MATH_ABS", offset);
+    case OP_MATH_COS:
+      return simpleInstruction("OP_MATH_COS", offset);
+    case OP_MATH_POW:
+      return simpleInstruction("OP_MATH_POW", offset);
+    case OP_MATH_SIN:
+      return simpleInstruction("OP_MATH_SIN", offset);
+    case OP_MATH_SQRT:
+      return simpleInstruction("OP_MATH_SQRT", offset);
     case OP_RANGE:
       return simpleInstruction("OP_RANGE", offset);
     case OP_MOD:
@@ -127,16 +165,38 @@ int disassembleInstruction(Chunk *chunk, int offset) {
       return simpleInstruction("OP_PRINT", offset);
     case OP_USE:
       return simpleInstruction("OP_USE", offset);
+    case OP_USE_NATIVE:
+      return simpleInstruction("OP_USE_NATIVE", offset);
     case OP_JUMP:
       return jumpInstruction("OP_JUMP", 1, chunk, offset);
     case OP_JUMP_IF_FALSE:
       return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
     case OP_LOOP:
       return jumpInstruction("OP_LOOP", -1, chunk, offset);
+    case OP_JUMP_IF_NOT_LESS:
+      return jumpInstruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER:
+      return jumpInstruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+    case OP_JUMP_IF_LESS:
+      return jumpInstruction("OP_JUMP_IF_LESS", 1, chunk, offset);
+    case OP_JUMP_IF_GREATER:
+      return jumpInstruction("OP_JUMP_IF_GREATER", 1, chunk, offset);
+    case OP_FOR_PREP:
+      return forInstruction("OP_FOR_PREP", 1, chunk, offset);
+    case OP_FOR_LOOP:
+      return forInstruction("OP_FOR_LOOP", -1, chunk, offset);
+    case OP_ITERATOR:
+      return simpleInstruction("OP_ITERATOR", offset);
+    case OP_IN:
+      return simpleInstruction("OP_IN", offset);
+    case OP_FOR_ITERATOR:
+      return iteratorInstruction("OP_FOR_ITERATOR", chunk, offset);
     case OP_CALL:
       return byteInstruction("OP_CALL", chunk, offset);
     case OP_INVOKE:
       return invokeInstruction("OP_INVOKE", chunk, offset);
+    case OP_INVOKE_NATIVE:
+      return invokeInstruction("OP_INVOKE_NATIVE", chunk, offset);
     case OP_SUPER_INVOKE:
       return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
     case OP_INDEX_SUBSCR:
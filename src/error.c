@@ -1,4 +1,5 @@
 #include "../include/error.h"
+#include "../include/vm.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,12 +18,12 @@ const char *getErrorCodeString(ErrorCode code) {
 
 void reportError(const Token *token, ErrorCode errorCode,
                  const char *errorMessage) {
-  fprintf(stderr, "\n\033[1;31merror\033[0m\033[1m[%s]\033[0m: %s\n",
+  writeError("\n\033[1;31merror\033[0m\033[1m[%s]\033[0m: %s\n",
           getErrorCodeString(errorCode), errorMessage);
 
   int column_offset = (int)(token->start - token->line_chars);
 
-  fprintf(stderr, " \033[1;34m-->\033[0m %s:%d:%d\n", CURRENT_FILE_PATH,
+  writeError(" \033[1;34m-->\033[0m %s:%d:%d\n", CURRENT_FILE_PATH,
           token->line, column_offset + 1);
 
   const char *lineStart = token->line_chars;
@@ -36,23 +37,23 @@ void reportError(const Token *token, ErrorCode errorCode,
   if (line_number_width < 0)
     line_number_width = 4;
 
-  fprintf(stderr, "\033[1m%*d\033[0m | ", line_number_width, token->line);
+  writeError("\033[1m%*d\033[0m | ", line_number_width, token->line);
 
-  fprintf(stderr, "%.*s\n", (int)(lineEnd - lineStart), lineStart);
+  writeError("%.*s\n", (int)(lineEnd - lineStart), lineStart);
 
   int padding_width = line_number_width + 3;
 
-  fprintf(stderr, "%*s|", padding_width - 2, " ");
+  writeError("%*s|", padding_width - 2, " ");
 
-  fprintf(stderr, "%*s", column_offset, "");
+  writeError("%*s", column_offset, "");
 
-  fprintf(stderr, "\033[1;31m");
+  writeError("\033[1;31m");
   for (int i = 0; i < token->length; i++) {
-    fprintf(stderr, "^");
+    writeError("^");
   }
-  fprintf(stderr, "\033[0m\n");
+  writeError("\033[0m\n");
 
-  fprintf(stderr, "%*s=\033[1m ", padding_width - 2, " ");
+  writeError("%*s=\033[1m ", padding_width - 2, " ");
 
-  fprintf(stderr, "%s\033[0m\n", errorMessage);
+  writeError("%s\033[0m\n", errorMessage);
 }
@@ -0,0 +1,76 @@
+#include <dlfcn.h>
+#include <string.h>
+
+#include "../include/extension.h"
+#include "../include/vm.h"
+#include "../module/modules.h"
+
+static int extensionCount = 0;
+
+/* Extensions can replace a built-in module, calls the compiler resolved
+ * to the old one have to look the module up again */
+static ObjNativeClass* defineExtensionModule(const char* name)
+{
+  Value existing;
+  if (tableGet(&vm.globals, copyString(name, strlen(name)), &existing))
+    vm.modulesRebound = true;
+
+  return defineModule(name, NULL);
+}
+
+static ObjString* stringFromValue(Value value)
+{
+  if (!isStringLike(value)) return NULL;
+  return AS_STRING(flattenValue(value));
+}
+
+static const ExtensionApi api = {
+  .version = MT_EXTENSION_VERSION,
+  .defineModule = defineExtensionModule,
+  .defineModuleMethod = defineModuleMethod,
+  .defineUnaryModuleMethod = defineUnaryModuleMethod,
+  .defineBinaryModuleMethod = defineBinaryModuleMethod,
+  .runtimeError = runtimeError,
+  .copyString = copyString,
+  .toString = stringFromValue,
+  .newList = newList,
+  .appendToList = appendToList,
+  .vmCall = vmCall,
+};
+
+/* Open a shared library and let it define its modules. Libraries stay
+ * open for as long as the vm runs since their natives may be anywhere */
+bool loadExtension(const char* path)
+{
+  void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (library == NULL)
+  {
+    runtimeError("Could not load native module '%s', %s.", path, dlerror());
+    return false;
+  }
+
+  ExtensionInit init;
+  *(void**)&init = dlsym(library, MT_EXTENSION_INIT_NAME);
+  if (init == NULL)
+  {
+    dlclose(library);
+    runtimeError("'%s' is not an mt extension, it has no %s.", path,
+                 MT_EXTENSION_INIT_NAME);
+    return false;
+  }
+
+  if (!init(&api))
+  {
+    runtimeError("'%s' could not set up its modules.", path);
+    return false;
+  }
+
+  extensionCount++;
+  return true;
+}
+
+/* Natives from a library can not be saved in a snapshot */
+bool extensionsLoaded()
+{
+  return extensionCount > 0;
+}
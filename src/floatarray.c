@@ -0,0 +1,116 @@
+#include "../include/floatarray.h"
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define FLOAT_SIMD
+#include <immintrin.h>
+#endif
+
+/* Scalar loops, also used for the tails of the vector loops. The pointer
+ * step lets b be a single broadcast value */
+static void scalarLoop(FloatOp op, double* dest, const double* a,
+                       const double* b, int bStep, int start, int count)
+{
+	for (int i = start; i < count; i++)
+	{
+		dest[i] = applyFloatOp(op, a[i], b[i * bStep]);
+	}
+}
+
+#ifdef FLOAT_SIMD
+
+/* Body of a vector loop for one instruction set, built from the VECTOR_*
+ * macros defined before each use */
+#define VECTOR_LOOP(add, sub, mul, div)                                  \
+	{                                                                    \
+		int i = 0;                                                       \
+		switch (op)                                                      \
+		{                                                                \
+		case FLOAT_ADD:      VECTOR_STEP(add); break;                    \
+		case FLOAT_SUBTRACT: VECTOR_STEP(sub); break;                    \
+		case FLOAT_MULTIPLY: VECTOR_STEP(mul); break;                    \
+		case FLOAT_DIVIDE:   VECTOR_STEP(div); break;                    \
+		case FLOAT_POW:      break;                                      \
+		}                                                                \
+		scalarLoop(op, dest, a, b, bStep, i, count);                     \
+	}
+
+/* b is either a full array or a single value repeated */
+#define VECTOR_STEP(instruction)                                         \
+	if (bStep == 0)                                                      \
+	{                                                                    \
+		VECTOR_TYPE vb = VECTOR_SPLAT(b[0]);                             \
+		for (; i + VECTOR_WIDTH <= count; i += VECTOR_WIDTH)             \
+			VECTOR_STORE(dest + i, instruction(VECTOR_LOAD(a + i), vb)); \
+	}                                                                    \
+	else                                                                 \
+	{                                                                    \
+		for (; i + VECTOR_WIDTH <= count; i += VECTOR_WIDTH)             \
+			VECTOR_STORE(dest + i, instruction(VECTOR_LOAD(a + i),       \
+			                                   VECTOR_LOAD(b + i)));     \
+	}
+
+#define VECTOR_TYPE        __m128d
+#define VECTOR_WIDTH       2
+#define VECTOR_LOAD(p)     _mm_loadu_pd(p)
+#define VECTOR_STORE(p, v) _mm_storeu_pd(p, v)
+#define VECTOR_SPLAT(x)    _mm_set1_pd(x)
+
+static void sse2Loop(FloatOp op, double* dest, const double* a,
+                     const double* b, int bStep, int count)
+VECTOR_LOOP(_mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd)
+
+#undef VECTOR_TYPE
+#undef VECTOR_WIDTH
+#undef VECTOR_LOAD
+#undef VECTOR_STORE
+#undef VECTOR_SPLAT
+
+#define VECTOR_TYPE        __m256d
+#define VECTOR_WIDTH       4
+#define VECTOR_LOAD(p)     _mm256_loadu_pd(p)
+#define VECTOR_STORE(p, v) _mm256_storeu_pd(p, v)
+#define VECTOR_SPLAT(x)    _mm256_set1_pd(x)
+
+__attribute__((target("avx")))
+static void avxLoop(FloatOp op, double* dest, const double* a,
+                    const double* b, int bStep, int count)
+VECTOR_LOOP(_mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd)
+
+#endif
+
+/* Pick the widest loop the cpu supports */
+static void runLoop(FloatOp op, double* dest, const double* a,
+                    const double* b, int bStep, int count)
+{
+#ifdef FLOAT_SIMD
+	static int hasAvx = -1;
+	if (hasAvx == -1) hasAvx = __builtin_cpu_supports("avx");
+
+	if (hasAvx) avxLoop(op, dest, a, b, bStep, count);
+	else sse2Loop(op, dest, a, b, bStep, count);
+#else
+	scalarLoop(op, dest, a, b, bStep, 0, count);
+#endif
+}
+
+void floatArrayOp(FloatOp op, double* dest, const double* a, const double* b,
+                  int count)
+{
+	runLoop(op, dest, a, b, 1, count);
+}
+
+void floatScalarOp(FloatOp op, double* dest, const double* a, double scalar,
+                   bool scalarFirst, int count)
+{
+	if (!scalarFirst || op == FLOAT_ADD || op == FLOAT_MULTIPLY)
+	{
+		runLoop(op, dest, a, &scalar, 0, count);
+		return;
+	}
+
+	// scalar - a[i] and scalar / a[i] are not commutative
+	for (int i = 0; i < count; i++)
+	{
+		dest[i] = applyFloatOp(op, scalar, a[i]);
+	}
+}
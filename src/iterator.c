@@ -7,12 +7,15 @@
 
 static void printIterator() 
 {
-  printf("<iterable>");
+  writeOutput("<iterable>");
 }
 
 ObjectIterator* newIterator() 
 {
   ObjectIterator* iter = ALLOCATE(ObjectIterator, 1);
+  iter->list = NULL;
+  iter->iter = 0;
+  iter->stream = NULL;
   return iter;
 }
 
@@ -32,6 +35,6 @@ void advanceIterator(ObjectIterator* iterable)
 
 Value valueFromIterable(ObjectIterator* iterable) 
 {
-  return iterable->list->items[iterable->iter];
+  return indexFromList(iterable->list, iterable->iter);
 }
 
@@ -9,6 +9,7 @@
 #include "../include/error.h"
 #include "../include/preproc.h"
 #include "../include/repl.h"
+#include "../include/snapshot.h"
 #include "../include/vm.h"
 
 /* current version */
@@ -64,17 +65,55 @@ static void runFile(const char *path) {
     exit(70);
 }
 
+/* Run the code given on the command line, mt -e '' times startup */
+static void runString(const char *source) {
+  CURRENT_FILE_PATH = "-e";
+
+  InterpretResult result = interpret(source);
+
+  if (result == INTERPRET_COMPILE_ERROR)
+    exit(65);
+  if (result == INTERPRET_RUNTIME_ERROR)
+    exit(70);
+}
+
+/* mt --snapshot out.img prelude.mt runs the prelude and saves the heap,
+ * mt --from-snapshot out.img script.mt starts from that heap */
+static void runSnapshot(const char *option, const char *image,
+                        const char *path) {
+  if (strcmp(option, "--snapshot") == 0) {
+    initVM(path);
+    runFile(path);
+    if (!saveSnapshot(image))
+      exit(74);
+  } else {
+    if (!initVMFromSnapshot(path, image))
+      exit(74);
+    runFile(path);
+  }
+
+  freeVM();
+}
+
 /* Main loop that handles all the command line arguments and such */
 int main(int argc, char *argv[]) {
+  if (argc == 4 && (strcmp(argv[1], "--snapshot") == 0 ||
+                    strcmp(argv[1], "--from-snapshot") == 0)) {
+    runSnapshot(argv[1], argv[2], argv[3]);
+    return 0;
+  }
+
   initVM(argv[1]);
 
   if (argc == 1) {
     CURRENT_FILE_PATH = "repl";
     repl();
+  } else if (argc == 3 && strcmp(argv[1], "-e") == 0) {
+    runString(argv[2]);
   } else if (argc == 2) {
     runFile(argv[1]);
-  } else
+  }
 
-    freeVM();
+  freeVM();
   return 0;
 }
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../include/map.h"
+#include "../include/memory.h"
+#include "../include/object.h"
+#include "../include/table.h"
+#include "../include/value.h"
+#include "../include/vm.h"
+
+#define MAP_MAX_LOAD 0.75
+
+/* Shrink once fewer than 1 in MAP_SHRINK_LOAD slots are live */
+#define MAP_SHRINK_LOAD 8
+
+/* free the entries of a map, the map object itself is freed by the
+ * caller */
+void freeMap(ObjMap* map)
+{
+	FREE_ARRAY(MapEntry, map->entries, map->capacity + 1);
+	FREE_ARRAY(uint8_t, map->control, map->capacity + 1);
+	map->count = 0;
+	map->tombstones = 0;
+	map->capacity = -1;
+	map->entries = NULL;
+	map->control = NULL;
+}
+
+/* Only values that compare by contents can be keys */
+bool isHashable(Value value)
+{
+	if (!IS_OBJ(value)) return true;
+
+	if (IS_STRING(value) || IS_ROPE(value)) return true;
+
+	if (IS_TUPLE(value))
+	{
+		// tuples only get a hash once they are known to be hashable
+		ObjTuple* tuple = AS_TUPLE(value);
+		if (tuple->hash != 0) return true;
+
+		for (int i = 0; i < tuple->count; i++)
+		{
+			if (!isHashable(tuple->items[i])) return false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/* Mix the bits of a number, 0 and -0 are equal so hash the same */
+static uint32_t hashNumber(double number)
+{
+	if (number == 0) number = 0;
+
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+
+	bits ^= bits >> 33;
+	bits *= 0xff51afd7ed558ccdull;
+	bits ^= bits >> 33;
+	return (uint32_t)bits;
+}
+
+/* Hash a value made hashable by isHashable */
+uint32_t hashValue(Value value)
+{
+	switch (value.type)
+	{
+	case VAL_BOOL:   return AS_BOOL(value) ? 0x9e3779b9u : 0x7f4a7c15u;
+	case VAL_NIL:    return 0x85ebca6bu;
+	case VAL_NUMBER: return hashNumber(AS_NUMBER(value));
+	case VAL_OBJ:    break;
+	}
+
+	value = flattenValue(value);
+
+	if (IS_STRING(value)) return internedString(AS_STRING(value))->hash;
+
+	// tuples are immutable so their hash is worked out once
+	ObjTuple* tuple = AS_TUPLE(value);
+	if (tuple->hash != 0) return tuple->hash;
+
+	uint32_t hash = 0x345678u ^ (uint32_t)tuple->count;
+	for (int i = 0; i < tuple->count; i++)
+	{
+		hash = (hash ^ hashValue(tuple->items[i])) * 0x01000193u;
+	}
+	hash ^= hash >> 15;
+
+	tuple->hash = hash == 0 ? 1 : hash;
+	return tuple->hash;
+}
+
+/* Tuples used as keys compare by their items */
+static bool keysEqual(Value a, Value b)
+{
+	if (IS_TUPLE(a) && IS_TUPLE(b))
+	{
+		ObjTuple* left = AS_TUPLE(a);
+		ObjTuple* right = AS_TUPLE(b);
+
+		if (left == right) return true;
+		if (left->count != right->count) return false;
+		if (left->hash != 0 && right->hash != 0 && left->hash != right->hash)
+			return false;
+
+		for (int i = 0; i < left->count; i++)
+		{
+			if (!keysEqual(left->items[i], right->items[i])) return false;
+		}
+		return true;
+	}
+
+	return valuesEqual(a, b);
+}
+
+/* Keys are stored flattened and interned so later compares are cheap */
+static Value normaliseKey(Value key)
+{
+	key = flattenValue(key);
+	if (IS_STRING(key)) key = OBJ_VAL(internedString(AS_STRING(key)));
+	return key;
+}
+
+/* Find the slot holding key, or -1 */
+static int findEntry(ObjMap* map, Value key, uint32_t hash)
+{
+	uint8_t control = HASH_CONTROL(hash);
+
+	FOR_EACH_GROUP(map->capacity, hash, group)
+	{
+		int start = group * TABLE_GROUP_SIZE;
+		const uint8_t* bytes = &map->control[start];
+
+		for (uint32_t match = groupMatchByte(bytes, control); match != 0;
+		     match &= match - 1)
+		{
+			int index = start + __builtin_ctz(match);
+			if (keysEqual(map->entries[index].key, key)) return index;
+		}
+
+		if (groupMatchByte(bytes, CONTROL_EMPTY) != 0) return -1;
+	}
+}
+
+/* Find the first empty or deleted slot for a key that is not in the map */
+static int findFreeSlot(uint8_t* control, int capacity, uint32_t hash)
+{
+	FOR_EACH_GROUP(capacity, hash, group)
+	{
+		int start = group * TABLE_GROUP_SIZE;
+		uint32_t match = groupMatchFree(&control[start]);
+
+		if (match != 0) return start + __builtin_ctz(match);
+	}
+}
+
+/* Move every entry into arrays of a new size */
+static void adjustCapacity(ObjMap* map, int capacity)
+{
+	MapEntry* entries = ALLOCATE(MapEntry, capacity + 1);
+	uint8_t* control = ALLOCATE(uint8_t, capacity + 1);
+	memset(control, CONTROL_EMPTY, capacity + 1);
+
+	for (int i = 0; i <= map->capacity; i++)
+	{
+		if (map->control[i] & 0x80) continue;
+
+		MapEntry* entry = &map->entries[i];
+		int index = findFreeSlot(control, capacity, hashValue(entry->key));
+		control[index] = map->control[i];
+		entries[index] = *entry;
+	}
+
+	FREE_ARRAY(MapEntry, map->entries, map->capacity + 1);
+	FREE_ARRAY(uint8_t, map->control, map->capacity + 1);
+	map->entries = entries;
+	map->control = control;
+	map->capacity = capacity;
+	map->tombstones = 0;
+}
+
+/* Make room for count entries up front so filling the map never has to
+ * grow it */
+void mapReserve(ObjMap* map, int count)
+{
+	int capacity = TABLE_GROUP_SIZE - 1;
+	while (count > (capacity + 1) * MAP_MAX_LOAD)
+	{
+		capacity = GROW_CAPACITY(capacity + 1) - 1;
+	}
+
+	if (capacity > map->capacity) adjustCapacity(map, capacity);
+}
+
+bool mapGet(ObjMap* map, Value key, Value* value)
+{
+	if (map->count == 0) return false;
+
+	key = normaliseKey(key);
+
+	int index = findEntry(map, key, hashValue(key));
+	if (index < 0) return false;
+
+	*value = map->entries[index].value;
+	return true;
+}
+
+/* Set a value in the map, returns true if the key is new */
+bool mapSet(ObjMap* map, Value key, Value value)
+{
+	key = normaliseKey(key);
+	uint32_t hash = hashValue(key);
+
+	if (map->count > 0)
+	{
+		int index = findEntry(map, key, hash);
+		if (index >= 0)
+		{
+			map->entries[index].value = value;
+			return false;
+		}
+	}
+
+	int used = map->count + map->tombstones;
+	if (used + 1 > (map->capacity + 1) * MAP_MAX_LOAD)
+	{
+		int capacity = map->capacity;
+
+		// Tombstones are cleared out by rehashing at the same size
+		if (map->tombstones <= map->count)
+		{
+			capacity = GROW_CAPACITY(map->capacity + 1) - 1;
+			if (capacity < TABLE_GROUP_SIZE - 1) capacity = TABLE_GROUP_SIZE - 1;
+		}
+
+		adjustCapacity(map, capacity);
+	}
+
+	int index = findFreeSlot(map->control, map->capacity, hash);
+	if (map->control[index] == CONTROL_DELETED) map->tombstones--;
+
+	map->control[index] = HASH_CONTROL(hash);
+	map->entries[index].key = key;
+	map->entries[index].value = value;
+	map->count++;
+	return true;
+}
+
+bool mapDelete(ObjMap* map, Value key)
+{
+	if (map->count == 0) return false;
+
+	key = normaliseKey(key);
+
+	int index = findEntry(map, key, hashValue(key));
+	if (index < 0) return false;
+
+	// A slot in a group with an empty slot can be emptied, as probing
+	// stops at that group anyway
+	int start = index & ~(TABLE_GROUP_SIZE - 1);
+	if (groupMatchByte(&map->control[start], CONTROL_EMPTY) != 0)
+	{
+		map->control[index] = CONTROL_EMPTY;
+	}
+	else
+	{
+		map->control[index] = CONTROL_DELETED;
+		map->tombstones++;
+	}
+	map->count--;
+
+	if (map->count == 0)
+	{
+		freeMap(map);
+	}
+	else if (map->capacity + 1 > TABLE_GROUP_SIZE &&
+	         map->count * MAP_SHRINK_LOAD < map->capacity + 1)
+	{
+		// Halve until a quarter of the slots are used
+		int capacity = map->capacity;
+		while (capacity + 1 > TABLE_GROUP_SIZE &&
+		       map->count * 4 < (capacity + 1) / 2)
+		{
+			capacity = (capacity + 1) / 2 - 1;
+		}
+		adjustCapacity(map, capacity);
+	}
+
+	return true;
+}
+
+/* Copy the keys out to a list, used to iterate over a map */
+ObjList* mapKeys(ObjMap* map)
+{
+	ObjList* keys = newList();
+
+	for (int i = 0; i <= map->capacity; i++)
+	{
+		if (map->control[i] & 0x80) continue;
+		appendToList(keys, map->entries[i].key);
+	}
+
+	return keys;
+}
+
+void printMap(ObjMap* map)
+{
+	writeOutput("{");
+
+	bool first = true;
+	for (int i = 0; i <= map->capacity; i++)
+	{
+		if (map->control[i] & 0x80) continue;
+
+		if (!first) writeOutput(", ");
+		first = false;
+
+		printValue(map->entries[i].key);
+		writeOutput(": ");
+		printValue(map->entries[i].value);
+	}
+
+	writeOutput("}");
+}
+
+void printSet(ObjSet* set)
+{
+	writeOutput("{");
+
+	bool first = true;
+	for (int i = 0; i <= set->capacity; i++)
+	{
+		if (set->control[i] & 0x80) continue;
+
+		if (!first) writeOutput(", ");
+		first = false;
+
+		printValue(set->entries[i].key);
+	}
+
+	writeOutput("}");
+}
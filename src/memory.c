@@ -1,9 +1,107 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../include/memory.h"
 #include "../include/vm.h"
 #include "../include/iterator.h"
+#include "../include/map.h"
+#include "../include/snapshot.h"
+
+/* Objects and arrays up to SMALL_OBJECT_MAX bytes are carved out of
+ * PAGE_SIZE pages in SIZE_CLASS_GRANULE steps, anything bigger goes
+ * straight to the system allocator. Freed small blocks are kept on a free
+ * list per size class and handed out again before the page is bumped. */
+#define SIZE_CLASS_GRANULE 16
+#define SMALL_OBJECT_MAX 256
+#define SIZE_CLASS_COUNT (SMALL_OBJECT_MAX / SIZE_CLASS_GRANULE)
+#define PAGE_SIZE (64 * 1024)
+
+/* A freed block, the link is stored in the block itself */
+typedef struct FreeBlock {
+  struct FreeBlock* next;
+} FreeBlock;
+
+/* Pages are chained through a header padded to keep blocks aligned */
+typedef union Page {
+  union Page* next;
+  long double align;
+} Page;
+
+static FreeBlock* freeLists[SIZE_CLASS_COUNT];
+static Page* pages = NULL;
+static uint8_t* pageTop = NULL;
+static uint8_t* pageEnd = NULL;
+
+AllocStats allocStats;
+
+/* Size class a request falls into, or -1 if it bypasses the pages */
+static inline int sizeClass(size_t size)
+{
+  if (size > SMALL_OBJECT_MAX) return -1;
+  return (int)((size + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE) - 1;
+}
+
+/* Get a fresh page to bump allocate from */
+static void newPage()
+{
+  Page* page = (Page*)malloc(PAGE_SIZE);
+  if (page == NULL)
+  {
+    fprintf(stderr, "Error allocating memory...\n");
+    exit(1);
+  }
+
+  page->next = pages;
+  pages = page;
+  pageTop = (uint8_t*)(page + 1);
+  pageEnd = (uint8_t*)page + PAGE_SIZE;
+  allocStats.pagesAllocated++;
+}
+
+/* Allocate a block from a size class */
+static void* allocateSmall(int sizeClass)
+{
+  allocStats.smallAllocations++;
+
+  FreeBlock* block = freeLists[sizeClass];
+  if (block != NULL)
+  {
+    freeLists[sizeClass] = block->next;
+    allocStats.freeListReuses++;
+    return block;
+  }
+
+  size_t size = (size_t)(sizeClass + 1) * SIZE_CLASS_GRANULE;
+  if (pageTop == NULL || pageEnd - pageTop < (ptrdiff_t)size) newPage();
+
+  void* result = pageTop;
+  pageTop += size;
+  return result;
+}
+
+/* Return a block to the free list of its size class */
+static void freeSmall(void* pointer, int sizeClass)
+{
+  FreeBlock* block = (FreeBlock*)pointer;
+  block->next = freeLists[sizeClass];
+  freeLists[sizeClass] = block;
+}
+
+/* Allocate a block too big for the pages */
+static void* allocateLarge(void* pointer, size_t newSize)
+{
+  void* result = realloc(pointer, newSize);
+  /* Handle memory full or similar */
+  if (result == NULL)
+  {
+    fprintf(stderr, "Error allocating memory...\n");
+    exit(1);
+  }
+
+  if (pointer == NULL) allocStats.largeAllocations++;
+  return result;
+}
 
 /* 
 reallocate is the main function used by mt for many 
@@ -17,29 +115,88 @@ purposes:
 | Non-Zero | >oldSize | Grow existing allocation   |
 |----------+----------+----------------------------|
 
-The reason to use one function is to improve garbage collection
+The reason to use one function is to improve garbage collection.
+oldSize must always be the size the block was last allocated with as
+it decides which size class the block is returned to. Blocks inside a
+loaded snapshot are left where they are.
 */
 void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 {
+	/* Snapshot memory is never freed, blocks in it are copied out the
+	 * first time they are resized */
+	if (isSnapshotMemory(pointer))
+	{
+		if (newSize == 0) return NULL;
+
+		void* result = reallocate(NULL, 0, newSize);
+		memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+		return result;
+	}
+
+	allocStats.bytesAllocated += newSize;
+	allocStats.bytesAllocated -= pointer == NULL ? 0 : oldSize;
+
+	int oldClass = pointer == NULL ? -1 : sizeClass(oldSize);
+
 	/* Passing zero means free memory */
 	if (newSize == 0)
 	{
-		free(pointer);
+		if (pointer == NULL) return NULL;
+
+		if (oldClass == -1) free(pointer);
+		else freeSmall(pointer, oldClass);
 		return NULL;
 	}
 
-	/* realloc the correct amount of memory */
-	void* result = realloc(pointer, newSize);
-	/* Handle memory full or similar */
-	if (result == NULL)
+	int newClass = sizeClass(newSize);
+
+	/* Both large, let the system allocator resize in place */
+	if (newClass == -1 && (pointer == NULL || oldClass == -1))
 	{
-		fprintf(stderr, "Error allocating memory...\n");
-		exit(1);
+		return allocateLarge(pointer, newSize);
 	}
-	
+
+	/* Still fits in the same block */
+	if (pointer != NULL && newClass == oldClass) return pointer;
+
+	void* result = newClass == -1 ? allocateLarge(NULL, newSize)
+	                              : allocateSmall(newClass);
+
+	if (pointer != NULL)
+	{
+		memcpy(result, pointer, oldSize < newSize ? oldSize : newSize);
+		if (oldClass == -1) free(pointer);
+		else freeSmall(pointer, oldClass);
+	}
+
 	return result;
 }
 
+/* Hand every page back to the system, all small blocks become invalid */
+void freePages()
+{
+	while (pages != NULL)
+	{
+		Page* next = pages->next;
+		free(pages);
+		pages = next;
+	}
+
+	for (int i = 0; i < SIZE_CLASS_COUNT; i++) freeLists[i] = NULL;
+	pageTop = NULL;
+	pageEnd = NULL;
+}
+
+/* Print the allocator counters */
+void printAllocStats()
+{
+	fprintf(stderr, "bytes allocated:   %zu\n", allocStats.bytesAllocated);
+	fprintf(stderr, "small allocations: %zu\n", allocStats.smallAllocations);
+	fprintf(stderr, "free list reuses:  %zu\n", allocStats.freeListReuses);
+	fprintf(stderr, "large allocations: %zu\n", allocStats.largeAllocations);
+	fprintf(stderr, "pages allocated:   %zu\n", allocStats.pagesAllocated);
+}
+
 /* freeObject is a method used to return the memory allocated 
  * by any of mt's internal objects such as stings and functions 
  * and others */
@@ -63,13 +220,32 @@ static void freeObject(Obj* object)
 
     case OBJ_LIST: 
     {
+        ObjList* list = (ObjList*)object;
+        if (list->strategy == LIST_NUMBERS)
+            FREE_ARRAY(double, list->numbers - list->head, list->head + list->capacity);
+        else if (list->strategy == LIST_VALUES)
+            FREE_ARRAY(Value, list->items - list->head, list->head + list->capacity);
         FREE(ObjList, object);
         break;
     }
 
     case OBJ_TUPLE: 
     {
-      FREE(ObjTuple, object);
+      ObjTuple* tuple = (ObjTuple*)object;
+      FREE_FLEX(ObjTuple, Value, object, tuple->count);
+      break;
+    }
+
+    case OBJ_FLOAT_ARRAY:
+    {
+      ObjFloatArray* array = (ObjFloatArray*)object;
+      FREE_FLEX(ObjFloatArray, double, object, array->count);
+      break;
+    }
+
+    case OBJ_STREAM:
+    {
+      FREE(ObjStream, object);
       break;
     }
 
@@ -98,8 +274,7 @@ static void freeObject(Obj* object)
     case OBJ_CLOSURE:
     {
     ObjClosure* closure = (ObjClosure*)object;
-    FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
-	FREE(ObjClosure, object);
+    FREE_FLEX(ObjClosure, ObjUpvalue*, object, closure->upvalueCount);
 	break;
     }
 
@@ -120,10 +295,17 @@ static void freeObject(Obj* object)
     {
 		
 		ObjString* string = (ObjString*)object;
-		FREE_ARRAY(char, string->chars, string->length + 1);
-		FREE(ObjString, object);
+		FREE_FLEX(ObjString, char, object, string->length + 1);
 		break;
 	}
+  case OBJ_ROPE:
+    FREE(ObjRope, object);
+    break;
+  case OBJ_MAP:
+  case OBJ_SET:
+    freeMap((ObjMap*)object);
+    FREE(ObjMap, object);
+    break;
   case OBJ_UPVALUE:
     FREE(ObjUpvalue, object);
     break;
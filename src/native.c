@@ -6,6 +6,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "../include/map.h"
 #include "../include/native.h"
 
 #define BUFFERSIZE 256
@@ -14,37 +15,10 @@
 //                     System Natives                         |
 // ------------------------------------------------------------
 
-/* read a file for built ins */
-static char *readFile(const char *path) {
-  FILE *file = fopen(path, "rb");
-  if (file == NULL) {
-    fprintf(stderr, "Could not open file \"%s\".\n", path);
-    exit(74);
-  }
-
-  fseek(file, 0L, SEEK_END);
-  size_t fileSize = ftell(file);
-  rewind(file);
-
-  char *buffer = (char *)malloc(fileSize + 1);
-  if (buffer == NULL) {
-    fprintf(stderr, "Not enough memory to read \"%s\".\n", path);
-    exit(74);
-  }
-  size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-  if (bytesRead < fileSize) {
-    fprintf(stderr, "Could not read file \"%s\".\n", path);
-    exit(74);
-  }
-  buffer[bytesRead] = '\0';
-
-  fclose(file);
-  return buffer;
-}
-
-/* Warn about fn misuse */
+/* Warn about fn misuse, the native should return straight after */
 static void warn(int expected, int argCount, const char *name) {
-  printf("Expected %d arguments to %s(), got %d.\n", expected, name, argCount);
+  runtimeError("Expected %d arguments to %s(), got %d.", expected, name,
+               argCount);
 }
 
 /* Provides the clock functionality a wrapper for C native */
@@ -55,8 +29,8 @@ Value clockNative(int argCount, Value *args) {
 /* Provides a built in sleep function */
 Value sleepNative(int argCount, Value *args) {
   if (argCount != 1) {
-    warn(1, argCount, "sleep()");
-    exit(74);
+    warn(1, argCount, "sleep");
+    return NIL_VAL;
   }
   sleep(AS_NUMBER(args[0]));
   return NUMBER_VAL(0);
@@ -66,16 +40,37 @@ Value sleepNative(int argCount, Value *args) {
 Value readNative(int argCount, Value *args) {
   if (argCount != 1) {
     warn(1, argCount, "read");
+    return NIL_VAL;
   }
   const char *path = AS_CSTRING(args[0]);
-  char *src = readFile(path);
-  return OBJ_VAL(copyString(src, strlen(src)));
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    runtimeError("Could not open file \"%s\".", path);
+    return NIL_VAL;
+  }
+
+  fseek(file, 0L, SEEK_END);
+  size_t fileSize = ftell(file);
+  rewind(file);
+
+  /* read straight into the string, long files are not hashed */
+  ObjString *string = newString(fileSize);
+  size_t bytesRead = fread(string->chars, sizeof(char), fileSize, file);
+  if (bytesRead < fileSize) {
+    fclose(file);
+    runtimeError("Could not read file \"%s\".", path);
+    return NIL_VAL;
+  }
+  fclose(file);
+
+  return OBJ_VAL(internString(string));
 }
 
 /* write to a file */
 Value writeNative(int argCount, Value *args) {
   if (argCount != 2) {
     warn(2, argCount, "write");
+    return NIL_VAL;
   }
   const char *path = AS_CSTRING(args[0]);
   const char *wrt = AS_CSTRING(args[1]);
@@ -84,7 +79,7 @@ Value writeNative(int argCount, Value *args) {
   fptr = fopen(path, "w");
 
   if (fptr == NULL) {
-    printf("Error wriiting to file.\n");
+    writeError("Error wriiting to file.\n");
     return NUMBER_VAL(1);
   }
 
@@ -96,6 +91,7 @@ Value writeNative(int argCount, Value *args) {
 Value randIntNative(int argCount, Value *args) {
   if (argCount != 2) {
     warn(2, argCount, "randInt");
+    return NIL_VAL;
   }
 
   int l;
@@ -114,7 +110,7 @@ Value inputNative(int argCount, Value *args) {
 
   if (argCount == 1) {
     const char *message = AS_CSTRING(args[0]);
-    printf("%s", message);
+    writeOutput("%s", message);
   }
 
   scanf("%[^\n]s", out);
@@ -126,6 +122,7 @@ Value inputNative(int argCount, Value *args) {
 Value doubleNative(int argCount, Value *args) {
   if (argCount != 1) {
     warn(1, argCount, "double");
+    return NIL_VAL;
   }
 
   switch (args[0].type) {
@@ -163,7 +160,7 @@ Value stringNative(int argCount, Value *args) {
     return OBJ_VAL(copyString("false", 5));
 
   case VAL_OBJ:
-    printf("Cannot assign object to string\n");
+    writeError("Cannot assign object to string\n");
     break;
 
   default:
@@ -180,20 +177,20 @@ Value exitNative(int argCount, Value *args) { exit(0); }
 
 /* Clear the screen on POSIX systems */
 Value clearNative(int argCount, Value *args) {
-  printf("\e[1;1H\e[2J");
+  writeOutput("\e[1;1H\e[2J");
   return NUMBER_VAL(0);
 }
 
 /* License infomation for the REPL */
 Value showNative(int argCount, Value *args) {
   if (argCount != 1)
-    printf("Please select an option");
+    writeOutput("Please select an option");
   const char *message = AS_CSTRING(args[0]);
 
   if (strcmp(message, "c") == 0) {
-    printf("See https://www.gnu.org/licenses/gpl-3.0.en.html\n");
+    writeOutput("See https://www.gnu.org/licenses/gpl-3.0.en.html\n");
   } else if (strcmp(message, "w") == 0) {
-    printf("See https://www.gnu.org/licenses/gpl-3.0.en.html\n");
+    writeOutput("See https://www.gnu.org/licenses/gpl-3.0.en.html\n");
   }
   return NUMBER_VAL(0);
 }
@@ -228,24 +225,24 @@ static void printNewline(const char *string) {
     if (string[i] == '\\') {
       switch (string[i + 1]) {
       case 'n':
-        printf("\n");
+        writeOutput("\n");
         i += 2;
         break;
       case 't':
-        printf("\t");
+        writeOutput("\t");
         i += 2;
         break;
       case 'r':
-        printf("\r");
+        writeOutput("\r");
         i += 2;
         break;
       case 'e':
-        printf("\e%c%c", string[i + 2], string[i + 3]);
+        writeOutput("\e%c%c", string[i + 2], string[i + 3]);
         i += 4;
         break;
       }
     }
-    printf("%c", string[i]);
+    writeOutput("%c", string[i]);
   }
   return;
 }
@@ -253,10 +250,11 @@ static void printNewline(const char *string) {
 /* C style printf function */
 Value printfNative(int argCount, Value *args) {
   /* Check we have the right number of args */
-  if (argCount < 1) {
-    printf("Nothing to print\n");
-    exit(EXIT_FAILURE);
+  if (argCount < 1 || !isStringLike(args[0])) {
+    runtimeError("printf() takes a format string.");
+    return NIL_VAL;
   }
+  args[0] = flattenValue(args[0]);
 
   char *str = AS_CSTRING(args[0]);
   /*
@@ -276,12 +274,12 @@ Value printfNative(int argCount, Value *args) {
     if (str[i] == '%') {
       switch (str[i + 1]) {
       case 'd':
-        printf("%lf", AS_NUMBER(args[escp]));
+        writeOutput("%lf", AS_NUMBER(args[escp]));
         escp++;
         i += 2;
         break;
       case 's':
-        printf("%s", AS_CSTRING(args[escp]));
+        writeOutput("%s", AS_CSTRING(args[escp]));
         escp++;
         i += 2;
         break;
@@ -291,21 +289,21 @@ Value printfNative(int argCount, Value *args) {
     if (str[i] == '\\') {
       switch (str[i + 1]) {
       case 'n':
-        printf("\n");
+        writeOutput("\n");
         i += 2;
         break;
       case 't':
-        printf("\t");
+        writeOutput("\t");
         i += 2;
         break;
       case 'r':
-        printf("\r");
+        writeOutput("\r");
         i += 2;
         break;
       }
     }
 
-    printf("%c", str[i]);
+    writeOutput("%c", str[i]);
   }
   return NUMBER_VAL(0);
 }
@@ -313,14 +311,16 @@ Value printfNative(int argCount, Value *args) {
 /* Identical to printf except adds a newline afterwards */
 Value printlnNative(int argCount, Value *args) {
   Value r = printfNative(argCount, args);
-  printf("\n");
+  if (vm.frameCount == 0)
+    return r;
+  writeOutput("\n");
   return r;
 }
 
 /* Print with more colors */
 Value colorSetNative(int argCount, Value *args) {
   if (argCount < 2) {
-    printf("Not enough arguments to color");
+    writeOutput("Not enough arguments to color");
   }
 
   char *color = AS_CSTRING(args[0]);
@@ -333,19 +333,19 @@ Value colorSetNative(int argCount, Value *args) {
   }
 
   if (strcmp(color, "red") == 0 || strcmp(color, "r") == 0) {
-    printf("\033[%d;31m", delim);
+    writeOutput("\033[%d;31m", delim);
   } else if (strcmp(color, "green") == 0 || strcmp(color, "g") == 0) {
-    printf("\033[%d;32m", delim);
+    writeOutput("\033[%d;32m", delim);
   } else if (strcmp(color, "yellow") == 0 || strcmp(color, "y") == 0) {
-    printf("\033[%d;33m", delim);
+    writeOutput("\033[%d;33m", delim);
   } else if (strcmp(color, "blue") == 0 || strcmp(color, "b") == 0) {
-    printf("\033[%d;34m", delim);
+    writeOutput("\033[%d;34m", delim);
   } else if (strcmp(color, "magenta") == 0 || strcmp(color, "m") == 0) {
-    printf("\033[%d;35m", delim);
+    writeOutput("\033[%d;35m", delim);
   } else if (strcmp(color, "cyan") == 0 || strcmp(color, "c") == 0) {
-    printf("\033[%d;36m", delim);
+    writeOutput("\033[%d;36m", delim);
   } else {
-    printf("\033[0m");
+    writeOutput("\033[0m");
   }
   return NUMBER_VAL(0);
 }
@@ -354,25 +354,25 @@ Value colorSetNative(int argCount, Value *args) {
 /* Print with more colors */
 Value bgSetNative(int argCount, Value *args) {
   if (argCount < 1) {
-    printf("Not enough arguments to color");
+    writeOutput("Not enough arguments to color");
   }
 
   char *color = AS_CSTRING(args[0]);
 
   if (strcmp(color, "red") == 0 || strcmp(color, "r") == 0) {
-    printf("\033[41m");
+    writeOutput("\033[41m");
   } else if (strcmp(color, "green") == 0 || strcmp(color, "g") == 0) {
-    printf("\033[42m");
+    writeOutput("\033[42m");
   } else if (strcmp(color, "yellow") == 0 || strcmp(color, "y") == 0) {
-    printf("\033[43m");
+    writeOutput("\033[43m");
   } else if (strcmp(color, "blue") == 0 || strcmp(color, "b") == 0) {
-    printf("\033[44m");
+    writeOutput("\033[44m");
   } else if (strcmp(color, "magenta") == 0 || strcmp(color, "m") == 0) {
-    printf("\033[45m");
+    writeOutput("\033[45m");
   } else if (strcmp(color, "cyan") == 0 || strcmp(color, "c") == 0) {
-    printf("\033[46m");
+    writeOutput("\033[46m");
   } else {
-    printf("\033[0m");
+    writeOutput("\033[0m");
   }
   return NUMBER_VAL(0);
 }
@@ -386,8 +386,8 @@ Value bgSetNative(int argCount, Value *args) {
 Value appendNative(int argCount, Value *args) {
   // Append a value to the end of a list increasing the list's length by 1
   if (argCount != 2 || !IS_LIST(args[0])) {
-    printf("List index out of range.\n");
-    exit(EXIT_FAILURE);
+    runtimeError("List index out of range.");
+    return NIL_VAL;
   }
   ObjList *list = AS_LIST(args[0]);
   Value item = args[1];
@@ -395,20 +395,28 @@ Value appendNative(int argCount, Value *args) {
   return NIL_VAL;
 }
 
-/* delete from a list */
+/* delete from a list by index, or from a map by key */
 Value deleteNative(int argCount, Value *args) {
+  if (argCount == 2 && (IS_MAP(args[0]) || IS_SET(args[0]))) {
+    if (!isHashable(args[1])) {
+      runtimeError("Map key must be a number, string, bool, nil or tuple.");
+      return NIL_VAL;
+    }
+    return BOOL_VAL(mapDelete(AS_MAP(args[0]), args[1]));
+  }
+
   // Delete an item from a list at the given index.
   if (argCount != 2 || !IS_LIST(args[0]) || !IS_NUMBER(args[1])) {
-    printf("List index out of range.\n");
-    exit(EXIT_FAILURE);
+    runtimeError("List index out of range.");
+    return NIL_VAL;
   }
 
   ObjList *list = AS_LIST(args[0]);
   int index = AS_NUMBER(args[1]);
 
   if (!isValidListIndex(list, index)) {
-    printf("List index out of range.\n");
-    exit(EXIT_FAILURE);
+    runtimeError("List index out of range.");
+    return NIL_VAL;
   }
 
   deleteFromList(list, index);
@@ -417,9 +425,15 @@ Value deleteNative(int argCount, Value *args) {
 
 /* Get the length of the list */
 Value lenNative(int argCount, Value *args) {
-  if (argCount != 1 || (!IS_LIST(args[0]) && !IS_STRING(args[0]))) {
-    printf("Cannot get length from no list/string object.\n");
-    exit(EXIT_FAILURE);
+  if (argCount != 1 || (!IS_LIST(args[0]) && !IS_STRING(args[0]) &&
+                        !IS_TUPLE(args[0]) && !IS_MAP(args[0]) &&
+                        !IS_SET(args[0]) && !IS_FLOAT_ARRAY(args[0]))) {
+    runtimeError("Cannot get length from no list/string/tuple/map/set/Float64 object.");
+    return NIL_VAL;
+  }
+
+  if (IS_MAP(args[0]) || IS_SET(args[0])) {
+    return NUMBER_VAL(AS_MAP(args[0])->count);
   }
 
   if (IS_LIST(args[0])) {
@@ -430,5 +444,9 @@ Value lenNative(int argCount, Value *args) {
     return NUMBER_VAL(AS_TUPLE(args[0])->count);
   }
 
+  if (IS_FLOAT_ARRAY(args[0])) {
+    return NUMBER_VAL(AS_FLOAT_ARRAY(args[0])->count);
+  }
+
   return NUMBER_VAL(strlen(AS_CSTRING(args[0])));
 }
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../include/map.h"
 #include "../include/memory.h"
 #include "../include/object.h"
 #include "../include/table.h"
@@ -10,6 +11,10 @@
 #define ALLOCATE_OBJ(type, objectType) \
     (type*)allocateObject(sizeof(type), objectType)
 
+/* Allocate an object with a trailing flexible array of count items */
+#define ALLOCATE_FLEX_OBJ(type, itemType, count, objectType) \
+    (type*)allocateObject(sizeof(type) + sizeof(itemType) * (count), objectType)
+
 
 static Obj* allocateObject(size_t size, ObjType type)
 {
@@ -48,7 +53,9 @@ ObjClass* newClass(ObjString* name)
 ObjNativeClass* newNativeClass(ObjString *name) {
     ObjNativeClass* klass = ALLOCATE_OBJ(ObjNativeClass, OBJ_NATIVE_CLASS);
     klass->name = name;
+    name->module = true;   // see modulesRebound
     initTable(&klass->methods);
+    klass->load = NULL;
     return klass;
 }
 
@@ -56,64 +63,309 @@ ObjNativeClass* newNativeClass(ObjString *name) {
 ObjList* newList()
 {
     ObjList* list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
-    list->items = NULL;
+    list->strategy = LIST_NUMBERS;
+    list->numbers = NULL;
     list->count = 0;
     list->capacity = 0;
+    list->head = 0;
+    list->offset = 0;
+    list->stride = 1;
+    list->views = NULL;
+    list->nextView = NULL;
     return list;
 }
 
-ObjTuple* newTuple() 
+ObjMap* newMap()
+{
+    ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+    map->count = 0;
+    map->tombstones = 0;
+    map->capacity = -1;
+    map->entries = NULL;
+    map->control = NULL;
+    return map;
+}
+
+ObjSet* newSet()
 {
-  ObjTuple* tuple = ALLOCATE_OBJ(ObjTuple, OBJ_TUPLE);
-  tuple->items = NULL;
-  tuple->count = 0;
-  tuple->capacity = 0;
+    ObjSet* set = ALLOCATE_OBJ(ObjSet, OBJ_SET);
+    set->count = 0;
+    set->tombstones = 0;
+    set->capacity = -1;
+    set->entries = NULL;
+    set->control = NULL;
+    return set;
+}
+
+/* Initialise a tuple of count items, the caller fills in the items
+ * before the tuple is visible to the user */
+ObjTuple* newTuple(int count) 
+{
+  ObjTuple* tuple = ALLOCATE_FLEX_OBJ(ObjTuple, Value, count, OBJ_TUPLE);
+  tuple->count = count;
+  tuple->hash = 0;
+  for (int i = 0; i < count; i++)
+    tuple->items[i] = NIL_VAL;
   return tuple;
 }
 
-/* Add a new value to the list */
-void appendToList(ObjList* list, Value value) 
+/* Float arrays start zero filled */
+ObjFloatArray* newFloatArray(int count)
+{
+  ObjFloatArray* array = ALLOCATE_FLEX_OBJ(ObjFloatArray, double, count,
+                                           OBJ_FLOAT_ARRAY);
+  array->count = count;
+  memset(array->items, 0, sizeof(double) * count);
+  return array;
+}
+
+ObjStream* newStream(StreamStage stage)
+{
+  ObjStream* stream = ALLOCATE_OBJ(ObjStream, OBJ_STREAM);
+  stream->stage = stage;
+  stream->used = false;
+  stream->source = NULL;
+  stream->fn = NIL_VAL;
+  stream->next = stream->end = stream->step = 0;
+  stream->position = 0;
+  stream->limit = 0;
+  return stream;
+}
+
+/* Copy a float array into a new list of numbers */
+ObjList* floatArrayToList(ObjFloatArray* array)
+{
+  ObjList* list = newList();
+  list->numbers = GROW_ARRAY(double, list->numbers, 0, array->count);
+  list->capacity = array->count;
+  memcpy(list->numbers, array->items, sizeof(double) * array->count);
+  list->count = array->count;
+  return list;
+}
+
+/* Box the items of a list of numbers so it can hold anything */
+void generaliseList(ObjList* list)
 {
-    if (list->capacity < list->count + 1) 
+    if (list->strategy == LIST_VALUES) return;
+
+    Value* items = ALLOCATE(Value, list->capacity);
+    for (int i = 0; i < list->count; i++)
+        items[i] = NUMBER_VAL(list->numbers[i]);
+
+    FREE_ARRAY(double, list->numbers - list->head, list->head + list->capacity);
+    list->items = items;
+    list->head = 0;
+    list->strategy = LIST_VALUES;
+}
+
+/* Unbox a list back to numbers, false if it holds anything else */
+bool specialiseList(ObjList* list)
+{
+    unshareList(list);
+    if (list->strategy == LIST_NUMBERS) return true;
+
+    for (int i = 0; i < list->count; i++)
+        if (!IS_NUMBER(list->items[i])) return false;
+
+    double* numbers = ALLOCATE(double, list->capacity);
+    for (int i = 0; i < list->count; i++)
+        numbers[i] = AS_NUMBER(list->items[i]);
+
+    FREE_ARRAY(Value, list->items - list->head, list->head + list->capacity);
+    list->numbers = numbers;
+    list->head = 0;
+    list->strategy = LIST_NUMBERS;
+    return true;
+}
+
+/* Views shorter than this are copied straight away */
+#define LIST_VIEW_MIN_LENGTH 16
+
+/* A list of count items read from list starting at start and moving by
+ * stride, which may be negative. Nothing is copied until one of the two
+ * lists is changed */
+ObjList* newListView(ObjList* list, int start, int count, int stride)
+{
+    if (count < LIST_VIEW_MIN_LENGTH)
     {
-        int oldCapacity = list->capacity;
-        list->capacity = GROW_CAPACITY(oldCapacity);
-        list->items = (Value*)reallocate(list->items, sizeof(Value)*oldCapacity, sizeof(Value)*list->capacity);
+        ObjList* copy = newList();
+        for (int i = 0; i < count; i++)
+            appendToList(copy, indexFromList(list, start + i * stride));
+        return copy;
     }
 
-    list->items[list->count] = value;
-    list->count++;
-    return;
+    // views of views read straight from the underlying list
+    if (list->strategy == LIST_VIEW)
+    {
+        start = list->offset + start * list->stride;
+        stride *= list->stride;
+        list = list->parent;
+    }
+
+    ObjList* view = newList();
+    view->strategy = LIST_VIEW;
+    view->parent = list;
+    view->count = count;
+    view->offset = start;
+    view->stride = stride;
+    view->nextView = list->views;
+    list->views = view;
+    return view;
+}
+
+/* Copy the items a view reads into storage of its own. The view stays on
+ * its parent's chain and is skipped once it is no longer a view */
+static void copyView(ObjList* view)
+{
+    ObjList* parent = view->parent;
+    int count = view->count;
+
+    if (parent->strategy == LIST_NUMBERS)
+    {
+        double* numbers = ALLOCATE(double, count);
+        for (int i = 0; i < count; i++)
+            numbers[i] = parent->numbers[view->offset + i * view->stride];
+        view->numbers = numbers;
+    }
+    else
+    {
+        Value* items = ALLOCATE(Value, count);
+        for (int i = 0; i < count; i++)
+            items[i] = parent->items[view->offset + i * view->stride];
+        view->items = items;
+    }
+
+    view->strategy = parent->strategy;
+    view->capacity = count;
+    view->head = 0;
+    view->offset = 0;
+    view->stride = 1;
+}
+
+/* Used by unshareList */
+void copyListViews(ObjList* list)
+{
+    if (list->strategy == LIST_VIEW) copyView(list);
+
+    ObjList* view = list->views;
+    while (view != NULL)
+    {
+        ObjList* next = view->nextView;
+        if (view->strategy == LIST_VIEW && view->parent == list) copyView(view);
+        view->nextView = NULL;
+        view = next;
+    }
+    list->views = NULL;
 }
 
+/* Size of one item in a list's storage */
+static inline size_t listItemSize(ObjList* list)
+{
+    return list->strategy == LIST_NUMBERS ? sizeof(double) : sizeof(Value);
+}
 
-/* Although tuples are immuatable we still need this method
- * to create them in the first place. To ensure immutablility t
- * this is never exposed to the user */
-void appendToTuple(ObjTuple* tuple, Value value) 
+/* Make room for an item at the end. Once shifting has left at least as
+ * many free slots at the front as there are items, the items move back
+ * to the start instead of growing the allocation */
+static void growListBack(ObjList* list)
 {
-    if (tuple->capacity < tuple->count + 1) 
+    size_t size = listItemSize(list);
+    char* base = (char*)list->items - size * list->head;
+
+    if (list->head > 0 && list->head >= list->count)
     {
-        int oldCapacity = tuple->capacity;
-        tuple->capacity = GROW_CAPACITY(oldCapacity);
-        tuple->items = (Value*)reallocate(tuple->items, sizeof(Value)*oldCapacity, sizeof(Value)*tuple->capacity);
+        memmove(base, list->items, size * list->count);
+        list->capacity += list->head;
+        list->head = 0;
+        list->items = (Value*)base;
+        return;
     }
 
-    tuple->items[tuple->count] = value;
-    tuple->count++;
+    int oldSlots = list->head + list->capacity;
+    int slots = GROW_CAPACITY(oldSlots);
+    base = reallocate(base, size * oldSlots, size * slots);
+    list->items = (Value*)(base + size * list->head);
+    list->capacity = slots - list->head;
+}
+
+/* Make room for an item at the front. The gap left is as large as the
+ * list, so a run of unshifts only copies the items each time it doubles */
+static void growListFront(ObjList* list)
+{
+    size_t size = listItemSize(list);
+    int gap = list->count < 8 ? 8 : list->count;
+    int oldSlots = list->head + list->capacity;
+    char* base = (char*)list->items - size * list->head;
+
+    char* grown = reallocate(NULL, 0, size * (gap + oldSlots));
+    if (list->count > 0)
+        memcpy(grown + size * (gap + list->head), list->items, size * list->count);
+    reallocate(base, size * oldSlots, 0);
+
+    list->items = (Value*)(grown + size * (gap + list->head));
+    list->head += gap;
+}
+
+/* Add a new value to the list, ropes are flattened so natives only
+ * ever find plain strings inside lists */
+void appendToList(ObjList* list, Value value) 
+{
+    value = flattenValue(value);
+    unshareList(list);
+    if (list->strategy == LIST_NUMBERS && !IS_NUMBER(value))
+        generaliseList(list);
+
+    if (list->capacity < list->count + 1) growListBack(list);
+
+    if (list->strategy == LIST_NUMBERS)
+        list->numbers[list->count] = AS_NUMBER(value);
+    else
+        list->items[list->count] = value;
+    list->count++;
     return;
 }
 
+
 /* Adds a value to s given place in a list */
 void storeToList(ObjList* list, int index, Value value) 
 {
+    value = flattenValue(value);
+    unshareList(list);
+    if (list->strategy == LIST_NUMBERS)
+    {
+        if (IS_NUMBER(value))
+        {
+            list->numbers[index] = AS_NUMBER(value);
+            return;
+        }
+        generaliseList(list);
+    }
     list->items[index] = value;
 }
 
-/* Get a value from a given index */
-Value indexFromList(ObjList* list, int index) 
+/* Add a value to the front of a list, used by arrays.Unshift */
+void prependToList(ObjList* list, Value value)
 {
-    return list->items[index];
+    value = flattenValue(value);
+    unshareList(list);
+    if (list->strategy == LIST_NUMBERS && !IS_NUMBER(value))
+        generaliseList(list);
+
+    if (list->head == 0) growListFront(list);
+
+    list->head--;
+    list->capacity++;
+    list->count++;
+    if (list->strategy == LIST_NUMBERS)
+    {
+        list->numbers--;
+        list->numbers[0] = AS_NUMBER(value);
+    }
+    else
+    {
+        list->items--;
+        list->items[0] = value;
+    }
 }
 
 Value indexFromTuple(ObjTuple* tuple, int index) 
@@ -121,14 +373,25 @@ Value indexFromTuple(ObjTuple* tuple, int index)
   return tuple->items[index];
 }
 
-/* Deletes an item from list */
+/* Deletes an item from list. Taking the first item only moves the start
+ * of the list along, so lists can be used as queues */
 void deleteFromList(ObjList* list, int index) 
 {
-    for (int i = 0; i < list->count - 1; i++) 
+    unshareList(list);
+    size_t size = listItemSize(list);
+
+    if (index == 0)
     {
-        list->items[i] = list->items[i+1]; 
+        list->items = (Value*)((char*)list->items + size);
+        list->head++;
+        list->capacity--;
+    }
+    else
+    {
+        char* items = (char*)list->items;
+        memmove(items + size * index, items + size * (index + 1),
+                size * (list->count - index - 1));
     }
-    list->items[list->count - 1] = NIL_VAL;
     list->count--;
 }
 
@@ -159,25 +422,28 @@ bool isValidStringIndex(ObjString* string, int index) {
     return true;
 }
 
+/* One char strings are kept on the vm so looping over a string does not
+ * hash and look up every char */
 Value indexFromString(ObjString* string, int index) {
-    ObjString* newString = copyString((char*)(string->chars + index), 1);
-    return OBJ_VAL(newString);
+    unsigned char c = string->chars[index];
+    if (vm.charStrings[c] == NULL) {
+        vm.charStrings[c] = copyString((char*)(string->chars + index), 1);
+    }
+    return OBJ_VAL(vm.charStrings[c]);
 }
 
 
 /* Initialise a new object closure */
 ObjClosure* newClosure(ObjFunction* function)
 {
-    ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
-
-    for (int i = 0; i < function->upvalueCount; i++)
-        upvalues[i] = NULL;
-
-    ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+    ObjClosure* closure = ALLOCATE_FLEX_OBJ(ObjClosure, ObjUpvalue*,
+                                            function->upvalueCount, OBJ_CLOSURE);
     closure->function = function;
-    closure->upvalues = upvalues;
     closure->upvalueCount = function->upvalueCount;
 
+    for (int i = 0; i < function->upvalueCount; i++)
+        closure->upvalues[i] = NULL;
+
     return closure;
 }
 
@@ -206,62 +472,346 @@ ObjNative* newNative(NativeFn function)
 {
     ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
     native->function = function;
+    native->module = NULL;
+    native->name = NULL;
+    native->numberArity = 0;
     return native;
 }
 
-static ObjString* allocateString(char* chars, int length, uint32_t hash)
+/* Constants from wyhash */
+#define HASH_SEED   0xa0761d6478bd642full
+#define HASH_MIX_1  0xe7037ed1a0b428dbull
+#define HASH_MIX_2  0x8ebc6af09c88c6e3ull
+#define HASH_MIX_3  0x589965cc75374cc3ull
+
+/* Inputs at least this long are hashed in four independent lanes */
+#define HASH_LANES_LENGTH 64
+
+/* Multiply two words and fold the 128 bit product back into 64 bits */
+static inline uint64_t hashMix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+	uint64_t high = (a >> 32) * (b >> 32) + ((a >> 32) * (uint32_t)b >> 32) +
+	                ((uint32_t)a * (b >> 32) >> 32);
+	return a * b ^ high;
+#endif
+}
+
+static inline uint64_t readWord(const char* p)
+{
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/* Read 1 to 8 bytes without going past the end of the input */
+static inline uint64_t readPartial(const char* p, int length)
+{
+	if (length >= 4)
+	{
+		uint32_t low, high;
+		memcpy(&low, p, 4);
+		memcpy(&high, p + length - 4, 4);
+		return (uint64_t)low << 32 | high;
+	}
+
+	return (uint64_t)(unsigned char)p[0] << 16 |
+	       (uint64_t)(unsigned char)p[length >> 1] << 8 |
+	       (unsigned char)p[length - 1];
+}
+
+/* Word at a time hash in the style of wyhash. Long inputs are split
+ * across four lanes so the multiplies do not wait on each other */
+static uint32_t hashString(const char * key, int length)
+{
+	uint64_t seed = HASH_SEED ^ hashMix(HASH_SEED ^ length, HASH_MIX_1);
+	const char* p = key;
+	int remaining = length;
+
+	if (remaining >= HASH_LANES_LENGTH)
+	{
+		uint64_t lanes[4] = { seed, seed ^ HASH_MIX_1, seed ^ HASH_MIX_2,
+		                      seed ^ HASH_MIX_3 };
+
+		do
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				lanes[i] = hashMix(readWord(p + i * 16) ^ HASH_MIX_1,
+				                   readWord(p + i * 16 + 8) ^ lanes[i]);
+			}
+			p += HASH_LANES_LENGTH;
+			remaining -= HASH_LANES_LENGTH;
+		} while (remaining >= HASH_LANES_LENGTH);
+
+		seed = hashMix(lanes[0] ^ HASH_MIX_2, lanes[1] ^ HASH_MIX_3) ^
+		       hashMix(lanes[2] ^ HASH_MIX_1, lanes[3] ^ HASH_MIX_2);
+	}
+
+	while (remaining > 16)
+	{
+		seed = hashMix(readWord(p) ^ HASH_MIX_1, readWord(p + 8) ^ seed);
+		p += 16;
+		remaining -= 16;
+	}
+
+	uint64_t a = 0, b = 0;
+	if (remaining > 8)
+	{
+		a = readWord(p);
+		b = readPartial(p + 8, remaining - 8);
+	}
+	else if (remaining > 0)
+	{
+		a = readPartial(p, remaining);
+	}
+
+	uint64_t hash = hashMix(HASH_MIX_1 ^ length,
+	                        hashMix(a ^ HASH_MIX_1, b ^ seed));
+
+	return (uint32_t)(hash ^ hash >> 32);
+}
+
+/* Link a string into the vm's object list */
+static ObjString* linkString(ObjString* string)
+{
+	string->obj.next = vm.objects;
+	vm.objects = (Obj*)string;
+	return string;
+}
+
+/* Add a filled in string to the vm and the intern table */
+static ObjString* trackString(ObjString* string, uint32_t hash)
 {
-	ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
 	string->hash = hash;
+	string->interned = true;
+	linkString(string);
 
 	tableSet(&vm.strings, string, NIL_VAL);
 	
 	return string;
 }
 
-/* FNV-1a hash function - could replace later with better hash */
-static uint32_t hashString(const char * key, int length)
+/* Start a string with room for length chars. It is not tracked by the vm
+ * until the caller has filled in the chars and passed it to internString */
+ObjString* newString(int length)
 {
-	uint32_t hash = 2166136261u;
+	ObjString* string = (ObjString*)reallocate(NULL, 0,
+	                                           sizeof(ObjString) + length + 1);
+	string->obj.type = OBJ_STRING;
+	string->obj.next = NULL;
+	string->length = length;
+	string->hash = 0;
+	string->interned = false;
+	string->module = false;
+	string->chars[length] = '\0';
+	return string;
+}
 
-	for (int i = 0; i < length; i++)
+/* Intern a string made by newString, if an equal string already exists
+ * the new one is freed and the existing one returned. Long strings are
+ * only linked into the vm, see internedString */
+ObjString* internString(ObjString* string)
+{
+	if (string->length >= LAZY_INTERN_LENGTH) return linkString(string);
+
+	uint32_t hash = hashString(string->chars, string->length);
+
+	ObjString* interned = tableFindString(&vm.strings, string->chars,
+	                                      string->length, hash);
+	if (interned != NULL)
 	{
-		hash ^= key[i];
-		hash *= 16777619;
+		FREE_FLEX(ObjString, char, string, string->length + 1);
+		return interned;
 	}
 
-	return hash;
+	return trackString(string, hash);
+}
+
+/* Intern a string that was left alone because of its length. A copy of
+ * one that is already interned keeps its hash so it is not hashed again
+ * every time it is used as a key */
+ObjString* internLongString(ObjString* string)
+{
+	if (string->hash == 0)
+		string->hash = hashString(string->chars, string->length);
+	uint32_t hash = string->hash;
+
+	ObjString* interned = tableFindString(&vm.strings, string->chars,
+	                                      string->length, hash);
+	if (interned != NULL) return interned;
+
+	string->interned = true;
+	tableSet(&vm.strings, string, NIL_VAL);
+
+	return string;
+}
+
+/* Interned strings are equal only if they are the same object, anything
+ * else has to compare the chars */
+bool stringsEqual(ObjString* a, ObjString* b)
+{
+	if (a == b) return true;
+	if (a->interned && b->interned) return false;
+
+	return a->length == b->length &&
+	       memcmp(a->chars, b->chars, a->length) == 0;
 }
 
 /* Take ownership of a string object */
 ObjString* takeString(char* chars, int length)
 {
-	uint32_t hash = hashString(chars, length);
+	ObjString* string = copyString(chars, length);
 
-	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
-	if (interned != NULL)
-	{
-		FREE_ARRAY(char, chars, length + 1);
-		return interned;
-	}
-	
-	return allocateString(chars, length, hash);
+	FREE_ARRAY(char, chars, length + 1);
+	return string;
 }
 
 ObjString* copyString(const char * chars, int length)
 {
+	if (length >= LAZY_INTERN_LENGTH)
+	{
+		ObjString* string = newString(length);
+		memcpy(string->chars, chars, length);
+		return linkString(string);
+	}
+
 	uint32_t hash = hashString(chars, length);
 	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
 
 	if (interned != NULL) return interned;
 	
-	char * heapChars = ALLOCATE(char, length+1);
-	memcpy(heapChars, chars, length);
-	heapChars[length] = '\0';
+	ObjString* string = newString(length);
+	memcpy(string->chars, chars, length);
 
-	return allocateString(heapChars, length, hash);
+	return trackString(string, hash);
+}
+
+/* Joins shorter than this are copied straight away */
+#define ROPE_MIN_LENGTH 64
+
+/* Length of a string or rope */
+static inline int stringLength(Obj* string)
+{
+	if (string->type == OBJ_ROPE) return ((ObjRope*)string)->length;
+	return ((ObjString*)string)->length;
+}
+
+/* Use the flattened string of a rope once there is one */
+static inline Obj* ropeContents(Obj* string)
+{
+	if (string->type == OBJ_ROPE && ((ObjRope*)string)->flat != NULL)
+	{
+		return (Obj*)((ObjRope*)string)->flat;
+	}
+	return string;
+}
+
+/* Join two strings or ropes for the + operator. Long results become a
+ * rope so repeatedly appending to a string does not copy it every time */
+Obj* joinStrings(Obj* a, Obj* b)
+{
+	a = ropeContents(a);
+	b = ropeContents(b);
+
+	int length = stringLength(a) + stringLength(b);
+
+	if (length >= ROPE_MIN_LENGTH)
+	{
+		ObjRope* rope = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+		rope->length = length;
+		rope->left = a;
+		rope->right = b;
+		rope->offset = 0;
+		rope->flat = NULL;
+		return (Obj*)rope;
+	}
+
+	ObjString* left = AS_STRING(flattenValue(OBJ_VAL(a)));
+	ObjString* right = AS_STRING(flattenValue(OBJ_VAL(b)));
+
+	ObjString* result = newString(length);
+	memcpy(result->chars, left->chars, left->length);
+	memcpy(result->chars + left->length, right->chars, right->length);
+
+	return (Obj*)internString(result);
+}
+
+/* length chars of string from start. Long slices share the string's
+ * characters until something needs them as a string of their own */
+Obj* sliceString(ObjString* string, int start, int length)
+{
+	if (length < ROPE_MIN_LENGTH)
+	{
+		return (Obj*)copyString(string->chars + start, length);
+	}
+
+	ObjRope* slice = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+	slice->length = length;
+	slice->left = (Obj*)string;
+	slice->right = NULL;
+	slice->offset = start;
+	slice->flat = NULL;
+	return (Obj*)slice;
+}
+
+/* Copy the leaves of a rope into one string. An explicit stack is used as
+ * ropes built in a loop are as deep as the loop is long */
+ObjString* flattenRope(ObjRope* rope)
+{
+	if (rope->flat != NULL) return rope->flat;
+
+	ObjString* string = newString(rope->length);
+	char* dest = string->chars;
+
+	Obj** stack = NULL;
+	int count = 0;
+	int capacity = 0;
+
+	Obj* node = (Obj*)rope;
+	for (;;)
+	{
+		node = ropeContents(node);
+
+		if (node->type == OBJ_ROPE && ((ObjRope*)node)->right == NULL)
+		{
+			// a slice, its chars are copied straight out of the string
+			ObjRope* slice = (ObjRope*)node;
+			memcpy(dest, ((ObjString*)slice->left)->chars + slice->offset,
+			       slice->length);
+			dest += slice->length;
+		}
+		else if (node->type == OBJ_ROPE)
+		{
+			if (capacity < count + 1)
+			{
+				int oldCapacity = capacity;
+				capacity = GROW_CAPACITY(oldCapacity);
+				stack = GROW_ARRAY(Obj*, stack, oldCapacity, capacity);
+			}
+
+			stack[count++] = ((ObjRope*)node)->right;
+			node = ((ObjRope*)node)->left;
+			continue;
+		}
+		else
+		{
+			ObjString* leaf = (ObjString*)node;
+			memcpy(dest, leaf->chars, leaf->length);
+			dest += leaf->length;
+		}
+
+		if (count == 0) break;
+		node = stack[--count];
+	}
+
+	FREE_ARRAY(Obj*, stack, capacity);
+
+	rope->flat = internString(string);
+	return rope->flat;
 }
 
 ObjUpvalue* newUpvalue(Value* slot) 
@@ -325,55 +875,66 @@ static void printFunction(ObjFunction* function)
 {
     if (function->name == NULL) 
     {
-        printf("<script>");
+        writeOutput("<script>");
         return;
     }
-    printf("<fn %s>", function->name->chars);
+    writeOutput("<fn %s>", function->name->chars);
 }
 
 /* Print a list object */
 static void printList(ObjList* list) 
 {
-    printf("[");
+    writeOutput("[");
     for (int i = 0; i < list->count - 1; i++) 
     {
-        printValue(list->items[i]);
-        printf(", ");
+        printValue(indexFromList(list, i));
+        writeOutput(", ");
     }
     if (list->count != 0) 
     {
-        printValue(list->items[list->count - 1]);
+        printValue(indexFromList(list, list->count - 1));
     }
-    printf("]");
+    writeOutput("]");
 }
 
 /* Print a list object */
 static void printTuple(ObjTuple* tuple) 
 {
-    printf("(");
+    writeOutput("(");
     for (int i = 0; i < tuple->count - 1; i++) 
     {
         printValue(tuple->items[i]);
-        printf(", ");
+        writeOutput(", ");
     }
     if (tuple->count != 0) 
     {
         printValue(tuple->items[tuple->count - 1]);
     }
-    printf(")");
+    writeOutput(")");
 }
 
+/* Print a float array */
+static void printFloatArray(ObjFloatArray* array)
+{
+    writeOutput("Float64[");
+    for (int i = 0; i < array->count; i++)
+    {
+        if (i != 0) writeOutput(", ");
+        printValue(NUMBER_VAL(array->items[i]));
+    }
+    writeOutput("]");
+}
 
 void printObject(Value value)
 {
     switch (OBJ_TYPE(value))
     {
     case OBJ_CLASS:
-        printf("%s", AS_CLASS(value)->name->chars);
+        writeOutput("%s", AS_CLASS(value)->name->chars);
         break;
     case OBJ_NATIVE_CLASS:
         // TODO fix this
-        printf("Internal class");
+        writeOutput("Internal class");
         break;
     case OBJ_CLOSURE:
 	    printFunction(AS_CLOSURE(value)->function);
@@ -384,19 +945,22 @@ void printObject(Value value)
         printFunction(AS_FUNCTION(value));
         break; 
     case OBJ_INSTANCE:
-        printf("%s instance", AS_INSTANCE(value)->klass->name->chars);
+        writeOutput("%s instance", AS_INSTANCE(value)->klass->name->chars);
         break;
     case OBJ_NATIVE:
-        printf("<native fn>");
+        writeOutput("<native fn>");
         break;
     case OBJ_STRING:
-    	printf("%s", AS_CSTRING(value));
+    	writeOutput("%s", AS_CSTRING(value));
+	    break;
+    case OBJ_ROPE:
+    	writeOutput("%s", flattenRope(AS_ROPE(value))->chars);
 	    break;
     case OBJ_UPVALUE:
-      printf("upvalue");
+      writeOutput("upvalue");
       break;
     case OBJ_MODULE:
-      printf("module");
+      writeOutput("module");
       break;
     case OBJ_LIST:
         printList(AS_LIST(value));
@@ -404,8 +968,20 @@ void printObject(Value value)
     case OBJ_TUPLE:
         printTuple(AS_TUPLE(value));
         break;
+    case OBJ_FLOAT_ARRAY:
+        printFloatArray(AS_FLOAT_ARRAY(value));
+        break;
+    case OBJ_MAP:
+        printMap(AS_MAP(value));
+        break;
+    case OBJ_SET:
+        printSet(AS_SET(value));
+        break;
+    case OBJ_STREAM:
+        writeOutput("<stream>");
+        break;
     case OBJ_ITERATOR:
-        printf("<iterator>");
+        writeOutput("<iterator>");
         break;
     default: break;
 	}
@@ -196,11 +196,12 @@ static TokenType identifierType() {
     if (scanner.current - scanner.start > 1) {
       switch (scanner.start[1]) {
       case 'f':
-        return TOKEN_IF;
+        return checkKeyword(2, 0, "", TOKEN_IF);
       case 'n':
-        return TOKEN_IN;
+        return checkKeyword(2, 0, "", TOKEN_IN);
       }
     }
+    break;
   case 'l':
     return checkKeyword(1, 2, "et", TOKEN_LET); // let x: type = type_inst;
   case 'n':
@@ -308,6 +309,15 @@ static Token number() {
   return makeToken(TOKEN_NUMBER);
 }
 
+/* The first char of the next token, the scanner is left where it was */
+char peekTokenStart() {
+  Scanner saved = scanner;
+  skipWhitespace();
+  char c = peek();
+  scanner = saved;
+  return c;
+}
+
 /* Scan the token in place */
 Token scanToken() {
   skipWhitespace();
@@ -0,0 +1,662 @@
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/extension.h"
+#include "../include/memory.h"
+#include "../include/object.h"
+#include "../include/snapshot.h"
+#include "../include/vm.h"
+
+#define SNAPSHOT_MAGIC "mtheap1"
+#define SNAPSHOT_ALIGN 16
+
+/* Fault the whole image in with one call where the system can */
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+/* C functions are stored relative to this one so an image still works
+ * wherever the binary is loaded */
+#define CODE_BASE ((uintptr_t)&initVM)
+
+uint8_t* snapshotStart = NULL;
+uint8_t* snapshotEnd = NULL;
+
+/* The start of an image. Until the image is relocated every pointer in
+ * it holds an offset from the start of the image */
+typedef struct
+{
+  char magic[8];
+  uint64_t layout[3];       // where a few functions are, only the binary
+                            // that wrote an image can load it
+  uint64_t size;
+  uint64_t relocations;     // offsets of the pointers into the image
+  uint64_t relocationCount;
+  uint64_t functions;       // offsets of the pointers to C functions
+  uint64_t functionCount;
+  Table globals;
+  Table strings;
+  Table imports;
+  ObjString* initString;
+  bool modulesRebound;
+} SnapshotHeader;
+
+/* Where an allocation was copied to */
+typedef struct
+{
+  const void* from;
+  size_t to;
+} Forward;
+
+/* An object that was copied but still points at the heap */
+typedef struct
+{
+  const Obj* from;
+  size_t to;
+} Pending;
+
+typedef struct
+{
+  uint8_t* image;
+  size_t size;
+  size_t capacity;
+
+  Forward* forwards;        // open addressing on the original address
+  size_t forwardCount;
+  size_t forwardCapacity;   // a power of two
+
+  Pending* pending;
+  size_t pendingCount;
+  size_t pendingCapacity;
+
+  uint64_t* relocations;
+  size_t relocationCount;
+  size_t relocationCapacity;
+
+  uint64_t* functions;
+  size_t functionCount;
+  size_t functionCapacity;
+
+  const char* error;
+} Writer;
+
+/* Fill in where this binary keeps a few of its functions */
+static void codeLayout(uint64_t layout[3])
+{
+  layout[0] = (uintptr_t)&runtimeError - CODE_BASE;
+  layout[1] = (uintptr_t)&reallocate - CODE_BASE;
+  layout[2] = (uintptr_t)&printObject - CODE_BASE;
+}
+
+/* Make room for size bytes at the end of the image, returns their offset */
+static size_t allocateImage(Writer* writer, size_t size)
+{
+  size_t offset = (writer->size + SNAPSHOT_ALIGN - 1) &
+                  ~(size_t)(SNAPSHOT_ALIGN - 1);
+
+  if (offset + size > writer->capacity)
+  {
+    size_t oldCapacity = writer->capacity;
+    size_t capacity = oldCapacity < 4096 ? 4096 : oldCapacity;
+    while (capacity < offset + size) capacity *= 2;
+
+    writer->image = GROW_ARRAY(uint8_t, writer->image, oldCapacity, capacity);
+    memset(writer->image + oldCapacity, 0, capacity - oldCapacity);
+    writer->capacity = capacity;
+  }
+
+  writer->size = offset + size;
+  return offset;
+}
+
+static size_t forwardSlot(Forward* forwards, size_t capacity, const void* from)
+{
+  size_t mask = capacity - 1;
+  size_t slot = (size_t)(((uint64_t)(uintptr_t)from >> 4) *
+                         0x9E3779B97F4A7C15ull) & mask;
+
+  while (forwards[slot].from != NULL && forwards[slot].from != from)
+    slot = (slot + 1) & mask;
+  return slot;
+}
+
+static bool findForward(Writer* writer, const void* from, size_t* to)
+{
+  if (writer->forwardCount == 0) return false;
+
+  Forward* forward = &writer->forwards[
+    forwardSlot(writer->forwards, writer->forwardCapacity, from)];
+  if (forward->from == NULL) return false;
+
+  *to = forward->to;
+  return true;
+}
+
+static void addForward(Writer* writer, const void* from, size_t to)
+{
+  if ((writer->forwardCount + 1) * 2 > writer->forwardCapacity)
+  {
+    size_t capacity = GROW_CAPACITY(writer->forwardCapacity);
+    Forward* forwards = ALLOCATE(Forward, capacity);
+    memset(forwards, 0, sizeof(Forward) * capacity);
+
+    for (size_t i = 0; i < writer->forwardCapacity; i++)
+    {
+      Forward* forward = &writer->forwards[i];
+      if (forward->from == NULL) continue;
+      forwards[forwardSlot(forwards, capacity, forward->from)] = *forward;
+    }
+
+    FREE_ARRAY(Forward, writer->forwards, writer->forwardCapacity);
+    writer->forwards = forwards;
+    writer->forwardCapacity = capacity;
+  }
+
+  Forward* forward = &writer->forwards[
+    forwardSlot(writer->forwards, writer->forwardCapacity, from)];
+  forward->from = from;
+  forward->to = to;
+  writer->forwardCount++;
+}
+
+static void addPending(Writer* writer, const Obj* from, size_t to)
+{
+  if (writer->pendingCount == writer->pendingCapacity)
+  {
+    size_t oldCapacity = writer->pendingCapacity;
+    writer->pendingCapacity = GROW_CAPACITY(oldCapacity);
+    writer->pending = GROW_ARRAY(Pending, writer->pending, oldCapacity,
+                                 writer->pendingCapacity);
+  }
+
+  writer->pending[writer->pendingCount++] = (Pending){ from, to };
+}
+
+static void addOffset(uint64_t** offsets, size_t* count, size_t* capacity,
+                      size_t at)
+{
+  if (*count == *capacity)
+  {
+    size_t oldCapacity = *capacity;
+    *capacity = GROW_CAPACITY(oldCapacity);
+    *offsets = GROW_ARRAY(uint64_t, *offsets, oldCapacity, *capacity);
+  }
+
+  (*offsets)[(*count)++] = at;
+}
+
+/* Copy an allocation to the end of the image, returns its offset */
+static size_t copyBlock(Writer* writer, const void* from, size_t size)
+{
+  size_t to = allocateImage(writer, size);
+  memcpy(writer->image + to, from, size);
+  addForward(writer, from, to);
+  return to;
+}
+
+static void* readPointer(Writer* writer, size_t at)
+{
+  void* pointer;
+  memcpy(&pointer, writer->image + at, sizeof(pointer));
+  return pointer;
+}
+
+/* Point the field at offset at to the offset target, it is relocated
+ * when the image is loaded */
+static void storeOffset(Writer* writer, size_t at, size_t target)
+{
+  uintptr_t pointer = target;
+  memcpy(writer->image + at, &pointer, sizeof(pointer));
+  addOffset(&writer->relocations, &writer->relocationCount,
+            &writer->relocationCapacity, at);
+}
+
+/* Bytes taken by an object, 0 if it can not be saved */
+static size_t objectSize(Writer* writer, const Obj* object)
+{
+  switch (object->type)
+  {
+    case OBJ_BOUND_METHOD: return sizeof(ObjBoundMethod);
+    case OBJ_CLASS:        return sizeof(ObjClass);
+    case OBJ_NATIVE_CLASS: return sizeof(ObjNativeClass);
+    case OBJ_CLOSURE:
+      return sizeof(ObjClosure) +
+             sizeof(ObjUpvalue*) * ((const ObjClosure*)object)->upvalueCount;
+    case OBJ_FUNCTION:     return sizeof(ObjFunction);
+    case OBJ_INSTANCE:     return sizeof(ObjInstance);
+    case OBJ_NATIVE:       return sizeof(ObjNative);
+    case OBJ_STRING:
+      return sizeof(ObjString) + ((const ObjString*)object)->length + 1;
+    case OBJ_ROPE:         return sizeof(ObjRope);
+    case OBJ_LIST:         return sizeof(ObjList);
+    case OBJ_TUPLE:
+      return sizeof(ObjTuple) +
+             sizeof(Value) * ((const ObjTuple*)object)->count;
+    case OBJ_FLOAT_ARRAY:
+      return sizeof(ObjFloatArray) +
+             sizeof(double) * ((const ObjFloatArray*)object)->count;
+    case OBJ_MAP:
+    case OBJ_SET:          return sizeof(ObjMap);
+    case OBJ_STREAM:       return sizeof(ObjStream);
+    case OBJ_UPVALUE:      return sizeof(ObjUpvalue);
+    case OBJ_MODULE:       return sizeof(ObjectModule);
+    case OBJ_ITERATOR:     break;
+  }
+
+  writer->error = "iterators can not be saved";
+  return 0;
+}
+
+/* Copy the object the field at offset at points to, once, and point the
+ * field at the copy */
+static void linkObject(Writer* writer, size_t at)
+{
+  const Obj* object = readPointer(writer, at);
+  if (object == NULL) return;
+
+  size_t to;
+  if (!findForward(writer, object, &to))
+  {
+    size_t size = objectSize(writer, object);
+    if (size == 0) return;
+
+    to = copyBlock(writer, object, size);
+    /* Saved objects are not on the object list, nothing frees them */
+    ((Obj*)(writer->image + to))->next = NULL;
+    addPending(writer, object, to);
+  }
+
+  storeOffset(writer, at, to);
+}
+
+/* Copy the buffer the field at offset at points skip bytes into,
+ * returns the offset of the copy */
+static size_t linkBuffer(Writer* writer, size_t at, size_t skip, size_t size)
+{
+  const uint8_t* pointer = readPointer(writer, at);
+  if (pointer == NULL) return 0;
+
+  size_t to = copyBlock(writer, pointer - skip, size);
+  storeOffset(writer, at, to + skip);
+  return to;
+}
+
+static void linkValue(Writer* writer, size_t at)
+{
+  Value value;
+  memcpy(&value, writer->image + at, sizeof(value));
+  if (IS_OBJ(value)) linkObject(writer, at + offsetof(Value, as));
+}
+
+/* Store a C function pointer relative to CODE_BASE */
+static void linkFunction(Writer* writer, size_t at)
+{
+  uintptr_t function;
+  memcpy(&function, writer->image + at, sizeof(function));
+  if (function == 0) return;
+
+  function -= CODE_BASE;
+  memcpy(writer->image + at, &function, sizeof(function));
+  addOffset(&writer->functions, &writer->functionCount,
+            &writer->functionCapacity, at);
+}
+
+static void linkTable(Writer* writer, size_t at)
+{
+  Table table;
+  memcpy(&table, writer->image + at, sizeof(table));
+  if (table.entries == NULL) return;
+
+  int slots = table.capacity + 1;
+  linkBuffer(writer, at + offsetof(Table, control), 0, slots);
+  size_t entries = linkBuffer(writer, at + offsetof(Table, entries), 0,
+                              sizeof(Entry) * slots);
+
+  for (int i = 0; i < slots; i++)
+  {
+    if (table.control[i] & 0x80) continue;
+
+    size_t entry = entries + sizeof(Entry) * i;
+    linkObject(writer, entry + offsetof(Entry, key));
+    linkValue(writer, entry + offsetof(Entry, value));
+  }
+}
+
+#define FIELD(type, field) (to + offsetof(type, field))
+
+/* Turn the pointers of a copied object into offsets, copying what they
+ * point to as well */
+static void linkFields(Writer* writer, const Obj* from, size_t to)
+{
+  switch (from->type)
+  {
+    case OBJ_BOUND_METHOD:
+      linkValue(writer, FIELD(ObjBoundMethod, reciever));
+      linkObject(writer, FIELD(ObjBoundMethod, method));
+      break;
+
+    case OBJ_CLASS:
+      linkObject(writer, FIELD(ObjClass, name));
+      linkTable(writer, FIELD(ObjClass, methods));
+      break;
+
+    case OBJ_NATIVE_CLASS:
+      linkObject(writer, FIELD(ObjNativeClass, name));
+      linkTable(writer, FIELD(ObjNativeClass, methods));
+      linkFunction(writer, FIELD(ObjNativeClass, load));
+      break;
+
+    case OBJ_CLOSURE:
+    {
+      const ObjClosure* closure = (const ObjClosure*)from;
+      linkObject(writer, FIELD(ObjClosure, function));
+      for (int i = 0; i < closure->upvalueCount; i++)
+        linkObject(writer, FIELD(ObjClosure, upvalues) + sizeof(ObjUpvalue*) * i);
+      break;
+    }
+
+    case OBJ_FUNCTION:
+    {
+      const Chunk* chunk = &((const ObjFunction*)from)->chunk;
+      linkBuffer(writer, FIELD(ObjFunction, chunk.code), 0, chunk->capacity);
+      linkBuffer(writer, FIELD(ObjFunction, chunk.lines), 0,
+                 sizeof(int) * chunk->capacity);
+
+      size_t constants = linkBuffer(writer,
+                                    FIELD(ObjFunction, chunk.constants.values), 0,
+                                    sizeof(Value) * chunk->constants.capacity);
+      for (int i = 0; i < chunk->constants.count; i++)
+        linkValue(writer, constants + sizeof(Value) * i);
+
+      linkObject(writer, FIELD(ObjFunction, name));
+      break;
+    }
+
+    case OBJ_INSTANCE:
+      linkObject(writer, FIELD(ObjInstance, klass));
+      linkTable(writer, FIELD(ObjInstance, fields));
+      break;
+
+    case OBJ_NATIVE:
+      linkFunction(writer, FIELD(ObjNative, function));
+      linkObject(writer, FIELD(ObjNative, module));
+      linkObject(writer, FIELD(ObjNative, name));
+      if (((const ObjNative*)from)->numberArity != 0)
+        linkFunction(writer, FIELD(ObjNative, unary));
+      break;
+
+    case OBJ_STRING:
+    case OBJ_FLOAT_ARRAY:
+      break;
+
+    case OBJ_ROPE:
+      linkObject(writer, FIELD(ObjRope, left));
+      linkObject(writer, FIELD(ObjRope, right));
+      linkObject(writer, FIELD(ObjRope, flat));
+      break;
+
+    case OBJ_LIST:
+    {
+      const ObjList* list = (const ObjList*)from;
+      if (list->strategy == LIST_NUMBERS)
+      {
+        linkBuffer(writer, FIELD(ObjList, numbers), sizeof(double) * list->head,
+                   sizeof(double) * (list->head + list->capacity));
+      }
+      else if (list->strategy == LIST_VALUES)
+      {
+        size_t items = linkBuffer(writer, FIELD(ObjList, items),
+                                  sizeof(Value) * list->head,
+                                  sizeof(Value) * (list->head + list->capacity));
+        for (int i = 0; i < list->count; i++)
+          linkValue(writer, items + sizeof(Value) * (list->head + i));
+      }
+      else
+      {
+        linkObject(writer, FIELD(ObjList, parent));
+      }
+
+      linkObject(writer, FIELD(ObjList, views));
+      linkObject(writer, FIELD(ObjList, nextView));
+      break;
+    }
+
+    case OBJ_TUPLE:
+      for (int i = 0; i < ((const ObjTuple*)from)->count; i++)
+        linkValue(writer, FIELD(ObjTuple, items) + sizeof(Value) * i);
+      break;
+
+    case OBJ_MAP:
+    case OBJ_SET:
+    {
+      const ObjMap* map = (const ObjMap*)from;
+      if (map->entries == NULL) break;
+
+      int slots = map->capacity + 1;
+      linkBuffer(writer, FIELD(ObjMap, control), 0, slots);
+      size_t entries = linkBuffer(writer, FIELD(ObjMap, entries), 0,
+                                  sizeof(MapEntry) * slots);
+
+      for (int i = 0; i < slots; i++)
+      {
+        if (map->control[i] & 0x80) continue;
+
+        size_t entry = entries + sizeof(MapEntry) * i;
+        linkValue(writer, entry + offsetof(MapEntry, key));
+        linkValue(writer, entry + offsetof(MapEntry, value));
+      }
+      break;
+    }
+
+    case OBJ_STREAM:
+      if (((const ObjStream*)from)->stage != STREAM_RANGE)
+        linkObject(writer, FIELD(ObjStream, source));
+      linkValue(writer, FIELD(ObjStream, fn));
+      break;
+
+    case OBJ_UPVALUE:
+    {
+      /* Upvalues are all closed once the prelude has returned, so they
+       * point at their own closed value */
+      const ObjUpvalue* upvalue = (const ObjUpvalue*)from;
+      if (upvalue->location != &upvalue->closed)
+      {
+        writer->error = "a captured variable is still open";
+        break;
+      }
+
+      storeOffset(writer, FIELD(ObjUpvalue, location), FIELD(ObjUpvalue, closed));
+      linkValue(writer, FIELD(ObjUpvalue, closed));
+      memset(writer->image + FIELD(ObjUpvalue, next), 0, sizeof(ObjUpvalue*));
+      break;
+    }
+
+    case OBJ_MODULE:
+      linkObject(writer, FIELD(ObjectModule, path));
+      linkObject(writer, FIELD(ObjectModule, name));
+      break;
+
+    case OBJ_ITERATOR:
+      break;
+  }
+}
+
+#undef FIELD
+
+static void freeWriter(Writer* writer)
+{
+  FREE_ARRAY(uint8_t, writer->image, writer->capacity);
+  FREE_ARRAY(Forward, writer->forwards, writer->forwardCapacity);
+  FREE_ARRAY(Pending, writer->pending, writer->pendingCapacity);
+  FREE_ARRAY(uint64_t, writer->relocations, writer->relocationCapacity);
+  FREE_ARRAY(uint64_t, writer->functions, writer->functionCapacity);
+}
+
+/* Write everything reachable from the vm's globals, strings and imports
+ * to path. Returns false and prints why if it could not */
+bool saveSnapshot(const char* path)
+{
+  if (extensionsLoaded())
+  {
+    fprintf(stderr, "Could not snapshot the heap, native extensions can "
+                    "not be saved.\n");
+    return false;
+  }
+
+  Writer writer;
+  memset(&writer, 0, sizeof(writer));
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  codeLayout(header.layout);
+  header.globals = vm.globals;
+  header.strings = vm.strings;
+  header.imports = vm.imports;
+  header.initString = vm.initString;
+  header.modulesRebound = vm.modulesRebound;
+
+  allocateImage(&writer, sizeof(header));
+  memcpy(writer.image, &header, sizeof(header));
+
+  linkTable(&writer, offsetof(SnapshotHeader, globals));
+  linkTable(&writer, offsetof(SnapshotHeader, strings));
+  linkTable(&writer, offsetof(SnapshotHeader, imports));
+  linkObject(&writer, offsetof(SnapshotHeader, initString));
+
+  /* Copying an object finds the ones it points to, carry on until
+   * there are no new ones */
+  while (writer.pendingCount > 0 && writer.error == NULL)
+  {
+    Pending pending = writer.pending[--writer.pendingCount];
+    linkFields(&writer, pending.from, pending.to);
+  }
+
+  size_t relocations = allocateImage(&writer,
+                                     sizeof(uint64_t) * writer.relocationCount);
+  memcpy(writer.image + relocations, writer.relocations,
+         sizeof(uint64_t) * writer.relocationCount);
+  size_t functions = allocateImage(&writer,
+                                   sizeof(uint64_t) * writer.functionCount);
+  memcpy(writer.image + functions, writer.functions,
+         sizeof(uint64_t) * writer.functionCount);
+
+  SnapshotHeader* written = (SnapshotHeader*)writer.image;
+  written->size = writer.size;
+  written->relocations = relocations;
+  written->relocationCount = writer.relocationCount;
+  written->functions = functions;
+  written->functionCount = writer.functionCount;
+
+  bool saved = false;
+  if (writer.error != NULL)
+  {
+    fprintf(stderr, "Could not snapshot the heap, %s.\n", writer.error);
+  }
+  else
+  {
+    FILE* file = fopen(path, "wb");
+    if (file != NULL)
+    {
+      saved = fwrite(writer.image, 1, writer.size, file) == writer.size;
+      saved = fclose(file) == 0 && saved;
+    }
+
+    if (!saved) fprintf(stderr, "Could not write snapshot to %s.\n", path);
+  }
+
+  freeWriter(&writer);
+  return saved;
+}
+
+/* Add base to each pointer listed in offsets */
+static bool relocate(uint8_t* image, size_t size, uint64_t offsets,
+                     uint64_t count, uintptr_t base)
+{
+  if (offsets > size || count > (size - offsets) / sizeof(uint64_t))
+    return false;
+
+  const uint64_t* at = (const uint64_t*)(image + offsets);
+  for (uint64_t i = 0; i < count; i++)
+  {
+    if (at[i] > size - sizeof(uintptr_t)) return false;
+    *(uintptr_t*)(image + at[i]) += base;
+  }
+
+  return true;
+}
+
+/* Map an image written by saveSnapshot and make its tables the vm's */
+bool loadSnapshot(const char* path)
+{
+  int file = open(path, O_RDONLY);
+  if (file < 0)
+  {
+    fprintf(stderr, "Could not open snapshot %s.\n", path);
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(file, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader))
+  {
+    close(file);
+    fprintf(stderr, "%s is not an mt snapshot.\n", path);
+    return false;
+  }
+
+  /* Private pages, relocating and running the script never write back
+   * to the file */
+  size_t size = (size_t)info.st_size;
+  uint8_t* image = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_POPULATE, file, 0);
+  close(file);
+
+  if (image == MAP_FAILED)
+  {
+    fprintf(stderr, "Could not map snapshot %s.\n", path);
+    return false;
+  }
+
+  SnapshotHeader* header = (SnapshotHeader*)image;
+  uint64_t layout[3];
+  codeLayout(layout);
+
+  if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+      memcmp(header->layout, layout, sizeof(layout)) != 0 ||
+      header->size != size ||
+      !relocate(image, size, header->relocations, header->relocationCount,
+                (uintptr_t)image) ||
+      !relocate(image, size, header->functions, header->functionCount,
+                CODE_BASE))
+  {
+    munmap(image, size);
+    fprintf(stderr, "%s was not written by this build of mt.\n", path);
+    return false;
+  }
+
+  snapshotStart = image;
+  snapshotEnd = image + size;
+
+  vm.globals = header->globals;
+  vm.strings = header->strings;
+  vm.imports = header->imports;
+  vm.initString = header->initString;
+  vm.modulesRebound = header->modulesRebound;
+  return true;
+}
+
+void unmapSnapshot()
+{
+  if (snapshotStart == NULL) return;
+
+  munmap(snapshotStart, snapshotEnd - snapshotStart);
+  snapshotStart = NULL;
+  snapshotEnd = NULL;
+}
@@ -0,0 +1,162 @@
+#include "../include/map.h"
+#include "../include/object.h"
+#include "../include/stream.h"
+#include "../include/vm.h"
+
+/* Wrap anything for-in can walk in a source stream, streams are returned
+ * as they are. Returns NULL if the value can not be streamed */
+ObjStream* streamFromValue(Value value)
+{
+  if (!IS_OBJ(value))
+    return NULL;
+
+  switch (OBJ_TYPE(value))
+  {
+    case OBJ_STREAM:
+      return AS_STREAM(value);
+
+    case OBJ_LIST:
+    {
+      ObjStream* stream = newStream(STREAM_LIST);
+      stream->list = AS_LIST(value);
+      return stream;
+    }
+
+    /* like for-in, walk a copy of the keys so the map can change */
+    case OBJ_MAP:
+    case OBJ_SET:
+    {
+      ObjStream* stream = newStream(STREAM_LIST);
+      stream->list = mapKeys(AS_MAP(value));
+      return stream;
+    }
+
+    case OBJ_FLOAT_ARRAY:
+    {
+      ObjStream* stream = newStream(STREAM_FLOAT_ARRAY);
+      stream->array = AS_FLOAT_ARRAY(value);
+      return stream;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+/* Stages keep their position, so each stream can only be read once */
+bool claimStream(ObjStream* stream)
+{
+  if (stream->used)
+  {
+    runtimeError("Stream has already been used.");
+    return false;
+  }
+
+  stream->used = true;
+  return true;
+}
+
+/* Pull the next item through the pipeline. Sources keep returning
+ * STREAM_END once they run out */
+StreamResult nextFromStream(ObjStream* stream, Value* item)
+{
+  switch (stream->stage)
+  {
+    case STREAM_LIST:
+      // the count is checked every time in case the list changes
+      if (stream->position >= stream->list->count)
+        return STREAM_END;
+
+      *item = indexFromList(stream->list, stream->position++);
+      return STREAM_ITEM;
+
+    case STREAM_FLOAT_ARRAY:
+      if (stream->position >= stream->array->count)
+        return STREAM_END;
+
+      *item = NUMBER_VAL(stream->array->items[stream->position++]);
+      return STREAM_ITEM;
+
+    case STREAM_RANGE:
+      if (stream->step > 0 ? stream->next > stream->end
+                           : stream->next < stream->end)
+        return STREAM_END;
+
+      *item = NUMBER_VAL(stream->next);
+      stream->next += stream->step;
+      return STREAM_ITEM;
+
+    case STREAM_MAP:
+    {
+      Value value;
+      StreamResult result = nextFromStream(stream->source, &value);
+      if (result != STREAM_ITEM)
+        return result;
+
+      return vmCall(stream->fn, &value, 1, item) ? STREAM_ITEM : STREAM_ERROR;
+    }
+
+    case STREAM_FILTER:
+      for (;;)
+      {
+        StreamResult result = nextFromStream(stream->source, item);
+        if (result != STREAM_ITEM)
+          return result;
+
+        Value keep;
+        if (!vmCall(stream->fn, item, 1, &keep))
+          return STREAM_ERROR;
+
+        if (!isFalsey(keep))
+          return STREAM_ITEM;
+      }
+
+    /* stops pulling once it has enough, so it can end an endless range */
+    case STREAM_TAKE:
+      if (stream->position >= stream->limit)
+        return STREAM_END;
+
+      stream->position++;
+      return nextFromStream(stream->source, item);
+
+    case STREAM_SKIP:
+      while (stream->position < stream->limit)
+      {
+        StreamResult result = nextFromStream(stream->source, item);
+        if (result != STREAM_ITEM)
+          return result;
+
+        stream->position++;
+      }
+
+      return nextFromStream(stream->source, item);
+
+    /* lists of limit items, the last one may be shorter */
+    case STREAM_CHUNK:
+    {
+      Value value;
+      StreamResult result = nextFromStream(stream->source, &value);
+      if (result != STREAM_ITEM)
+        return result;
+
+      ObjList* chunk = newList();
+      appendToList(chunk, value);
+
+      while (chunk->count < stream->limit)
+      {
+        result = nextFromStream(stream->source, &value);
+        if (result == STREAM_ERROR)
+          return STREAM_ERROR;
+        if (result == STREAM_END)
+          break;
+
+        appendToList(chunk, value);
+      }
+
+      *item = OBJ_VAL(chunk);
+      return STREAM_ITEM;
+    }
+  }
+
+  return STREAM_END;
+}
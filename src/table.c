@@ -8,51 +8,70 @@
 
 #define TABLE_MAX_LOAD 0.75
 
+/* Shrink once fewer than 1 in TABLE_SHRINK_LOAD slots are live */
+#define TABLE_SHRINK_LOAD 8
+
 /* Init all the hash tables values to zero */
 void initTable(Table* table)
 {
 	table->count = 0;
+	table->tombstones = 0;
 	table->capacity = -1;
 	table->entries = NULL;
+	table->control = NULL;
 }
 
 /* free the memory ascociated with the hash table */
 void freeTable(Table* table)
 {
-	FREE_ARRAY(Entry, table->entries, table->capacity);
+	FREE_ARRAY(Entry, table->entries, table->capacity + 1);
+	FREE_ARRAY(uint8_t, table->control, table->capacity + 1);
 	initTable(table);
 }
 
-/* Find if an entry exists in the table */
-static Entry* findEntry(Entry* entries, int capacity, ObjString* key)
+/* Search the groups for a key that is not in its home slot */
+static int probeEntry(Table* table, ObjString* key)
 {
-  uint32_t index = key->hash & capacity;
-	Entry* tombstone = NULL;
-	
-	while (1)
+	uint8_t control = HASH_CONTROL(key->hash);
+
+	FOR_EACH_GROUP(table->capacity, key->hash, group)
 	{
-		Entry* entry = &entries[index];
+		int start = group * TABLE_GROUP_SIZE;
+		const uint8_t* bytes = &table->control[start];
 
-		if (entry->key == NULL)
+		for (uint32_t match = groupMatchByte(bytes, control); match != 0;
+		     match &= match - 1)
 		{
-			if (IS_NIL(entry->value))
-			{
-				// Empty entry.
-				return tombstone != NULL ? tombstone : entry;
-			}
-			else
-			{
-				// We found a tombstone.
-				if (tombstone == NULL) tombstone = entry;
-			}
-		}
-		else if (entry->key == key)
-		{
-			// We found the key.
-			return entry;
+			int index = start + __builtin_ctz(match);
+			if (table->entries[index].key == key) return index;
 		}
 
-		index = (index + 1) & capacity;
+		if (groupMatchByte(bytes, CONTROL_EMPTY) != 0) return -1;
+	}
+}
+
+/* Find the slot holding key, or -1 */
+static inline int findEntry(Table* table, ObjString* key)
+{
+	// Most keys sit in their home slot, check it before the groups
+	int home = HASH_SLOT(key->hash) & table->capacity;
+	if (table->entries[home].key == key) return home;
+
+	return probeEntry(table, key);
+}
+
+/* Find the first empty or deleted slot for a key that is not in the table */
+static int findFreeSlot(uint8_t* control, int capacity, uint32_t hash)
+{
+	int home = HASH_SLOT(hash) & capacity;
+	if (control[home] & 0x80) return home;
+
+	FOR_EACH_GROUP(capacity, hash, group)
+	{
+		int start = group * TABLE_GROUP_SIZE;
+		uint32_t match = groupMatchFree(&control[start]);
+
+		if (match != 0) return start + __builtin_ctz(match);
 	}
 }
 
@@ -60,10 +79,12 @@ bool tableGet(Table* table, ObjString* key, Value* value)
 {
 	if (table->count == 0) return false;
 
-	Entry* entry = findEntry(table->entries, table->capacity, key);
-	if (entry->key == NULL) return false;
+	key = internedString(key);
+
+	int index = findEntry(table, key);
+	if (index < 0) return false;
 
-	*value = entry->value;
+	*value = table->entries[index].value;
 	return true;
 }
 
@@ -71,59 +92,116 @@ bool tableGet(Table* table, ObjString* key, Value* value)
 static void adjustCapacity(Table* table, int capacity)
 {
 	Entry* entries = ALLOCATE(Entry, capacity+1);
-	for (int i = 0; i <= capacity; i++)
-	{
-		entries[i].key = NULL;
-		entries[i].value = NIL_VAL;
-	}
+	uint8_t* control = ALLOCATE(uint8_t, capacity+1);
+	memset(control, CONTROL_EMPTY, capacity+1);
+	for (int i = 0; i <= capacity; i++) entries[i].key = NULL;
 
 	table->count = 0;
+	table->tombstones = 0;
 	for (int i = 0; i <= table->capacity; i++)
 	{
-		Entry* entry = &table->entries[i];
-		if (entry->key == NULL) continue;
+		if (table->control[i] & 0x80) continue;
 
-		Entry* dest = findEntry(entries, capacity, entry->key);
-		dest->key = entry->key;
-		dest->value = entry->value;
+		Entry* entry = &table->entries[i];
+		int index = findFreeSlot(control, capacity, entry->key->hash);
+		control[index] = table->control[i];
+		entries[index] = *entry;
 		table->count++;
 	}
 
 	FREE_ARRAY(Entry, table->entries, table->capacity+1);
+	FREE_ARRAY(uint8_t, table->control, table->capacity+1);
 	table->entries = entries;
+	table->control = control;
 	table->capacity = capacity;
 }
 
 /* Set a value in the hashtable */
 bool tableSet(Table* table, ObjString* key, Value value)
 {
+	key = internedString(key);
+
+	if (table->count > 0)
+	{
+		int index = findEntry(table, key);
+		if (index >= 0)
+		{
+			table->entries[index].value = value;
+			return false;
+		}
+	}
+
 	if (table->count + 1 > (table->capacity + 1) * TABLE_MAX_LOAD)
 	{
-		int capacity = GROW_CAPACITY(table->capacity+1)-1;
+		int capacity = table->capacity;
+
+		// Only grow if the table is mostly live entries, otherwise
+		// rehashing at the same size clears out the tombstones
+		if (table->tombstones * 2 <= table->count)
+		{
+			capacity = GROW_CAPACITY(table->capacity+1)-1;
+			if (capacity < TABLE_GROUP_SIZE - 1) capacity = TABLE_GROUP_SIZE - 1;
+		}
+
 		adjustCapacity(table, capacity);
 	}
 	
-	Entry* entry = findEntry(table->entries, table->capacity, key);
+	int index = findFreeSlot(table->control, table->capacity, key->hash);
 
-	bool isNewKey = entry->key == NULL;
-	if (isNewKey && IS_NIL(entry->value)) table->count++;
+	// Deleted slots are still counted in count
+	if (table->control[index] == CONTROL_EMPTY) table->count++;
+	else table->tombstones--;
 
-	entry->key = key;
-	entry->value = value;
-	return isNewKey;
+	table->control[index] = HASH_CONTROL(key->hash);
+	table->entries[index].key = key;
+	table->entries[index].value = value;
+	return true;
 }
 
 bool tableDelete(Table* table, ObjString* key)
 {
 	if (table->count == 0) return false;
+
+	key = internedString(key);
 	
 	// Find the entry.
-	Entry* entry = findEntry(table->entries, table->capacity, key);
-	if (entry->key == NULL) return false;
+	int index = findEntry(table, key);
+	if (index < 0) return false;
+
+	table->entries[index].key = NULL;
+	table->entries[index].value = NIL_VAL;
 
-	// Place a tombstone in the entry.
-	entry->key = NULL;
-	entry->value = BOOL_VAL(true);
+	// Probing stops at a group with an empty slot, so a slot in such a
+	// group can be emptied. Otherwise leave a tombstone so probing
+	// carries on past it.
+	int start = index & ~(TABLE_GROUP_SIZE - 1);
+	if (groupMatchByte(&table->control[start], CONTROL_EMPTY) != 0)
+	{
+		table->control[index] = CONTROL_EMPTY;
+		table->count--;
+	}
+	else
+	{
+		table->control[index] = CONTROL_DELETED;
+		table->tombstones++;
+	}
+
+	int live = table->count - table->tombstones;
+	if (live == 0)
+	{
+		freeTable(table);
+	}
+	else if (table->capacity + 1 > TABLE_GROUP_SIZE &&
+	         live * TABLE_SHRINK_LOAD < table->capacity + 1)
+	{
+		// Halve until a quarter of the slots are used
+		int capacity = table->capacity;
+		while (capacity + 1 > TABLE_GROUP_SIZE && live * 4 < (capacity + 1) / 2)
+		{
+			capacity = (capacity + 1) / 2 - 1;
+		}
+		adjustCapacity(table, capacity);
+	}
 	
 	return true;
 }
@@ -133,11 +211,10 @@ void tableAddAll(Table* from, Table* to)
 {
 	for (int i = 0; i <= from->capacity; i++)
 	{
+		if (from->control[i] & 0x80) continue;
+
 		Entry* entry = &from->entries[i];
-		if (entry->key != NULL)
-		{
-			tableSet(to, entry->key, entry->value);
-		}
+		tableSet(to, entry->key, entry->value);
 	}
 }
 
@@ -145,25 +222,28 @@ ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t
 {
 	if (table->count == 0) return NULL;
 
-	uint32_t index = hash & table->capacity;
+	uint8_t control = HASH_CONTROL(hash);
 
-	for (;;)
+	FOR_EACH_GROUP(table->capacity, hash, group)
 	{
-		Entry* entry = &table->entries[index];
-		
-		if (entry->key == NULL)
-		{
-	    // Stop if we find an empty non-tombstone entry.
-	    if (IS_NIL(entry->value)) return NULL;
-		}
-		else if (entry->key->length == length &&
-			 entry->key->hash == hash &&
-			 memcmp(entry->key->chars, chars, length) == 0)
+		int start = group * TABLE_GROUP_SIZE;
+		const uint8_t* bytes = &table->control[start];
+
+		for (uint32_t match = groupMatchByte(bytes, control); match != 0;
+		     match &= match - 1)
 		{
-			// We found it.
-			return entry->key;
+			ObjString* key = table->entries[start + __builtin_ctz(match)].key;
+
+			if (key->length == length &&
+			    key->hash == hash &&
+			    memcmp(key->chars, chars, length) == 0)
+			{
+				// We found it.
+				return key;
+			}
 		}
 
-		index = (index + 1) & table->capacity;
+		// Stop if the group has an empty non-tombstone slot.
+		if (groupMatchByte(bytes, CONTROL_EMPTY) != 0) return NULL;
 	}
 }
@@ -4,6 +4,7 @@
 #include "../include/object.h"
 #include "../include/value.h"
 #include "../include/memory.h"
+#include "../include/vm.h"
 
 /* Initialise to a zero value */
 void initValueArray(ValueArray* array)
@@ -39,9 +40,9 @@ void printValue(Value value)
 {
 	switch (value.type)
 	{
-	case VAL_BOOL:   printf(AS_BOOL(value) ? "true" : "false"); break;
-	case VAL_NIL:    printf("nil"); break;
-	case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+	case VAL_BOOL:   writeOutput(AS_BOOL(value) ? "true" : "false"); break;
+	case VAL_NIL:    writeOutput("nil"); break;
+	case VAL_NUMBER: writeOutput("%g", AS_NUMBER(value)); break;
 	case VAL_OBJ:    printObject(value); break;
 	}
 }
@@ -50,12 +51,21 @@ bool valuesEqual(Value a, Value b)
 {
 	if (a.type != b.type) return false;
 
+	/* ropes are compared by their interned contents */
+	a = flattenValue(a);
+	b = flattenValue(b);
+
 	switch (a.type)
 	{
 	case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
 	case VAL_NIL: return true;
 	case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
-	case VAL_OBJ: return AS_OBJ(a) == AS_OBJ(b);
+	case VAL_OBJ:
+		if (IS_STRING(a) && IS_STRING(b))
+		{
+			return stringsEqual(AS_STRING(a), AS_STRING(b));
+		}
+		return AS_OBJ(a) == AS_OBJ(b);
 	default:
 		return false; // unreachable
 	}
@@ -14,6 +14,11 @@
 #include "../include/vm.h"
 #include "../include/preproc.h"
 #include "../include/iterator.h"
+#include "../include/map.h"
+#include "../include/floatarray.h"
+#include "../include/stream.h"
+#include "../include/snapshot.h"
+#include "../include/extension.h"
 
 
 /* Maybe take a pointer later to remove the global variable */
@@ -33,24 +38,64 @@ static void resetStack() {
   vm.openUpvalues = NULL;
 }
 
+/* Format to a file, or to the host's callback when there is one */
+static void writeTo(WriteFn write, FILE *file, const char *format,
+                    va_list args) {
+  if (write == NULL) {
+    vfprintf(file, format, args);
+    return;
+  }
+
+  char buffer[256];
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+
+  if (length >= (int)sizeof(buffer)) {
+    char *text = malloc(length + 1);
+    vsnprintf(text, length + 1, format, copy);
+    write(text, length, vm.writeData);
+    free(text);
+  } else if (length > 0) {
+    write(buffer, length, vm.writeData);
+  }
+  va_end(copy);
+}
+
+/* Everything scripts print goes through here */
+void writeOutput(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  writeTo(vm.writeOutput, stdout, format, args);
+  va_end(args);
+}
+
+/* Compile and runtime errors go through here */
+void writeError(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  writeTo(vm.writeError, stderr, format, args);
+  va_end(args);
+}
+
 void runtimeError(const char *format, ...) {
   va_list args;
   va_start(args, format);
-  vfprintf(stderr, format, args);
+  writeTo(vm.writeError, stderr, format, args);
   va_end(args);
-  fputs("\n", stderr);
+  writeError("\n");
 
   for (int i = vm.frameCount - 1; i >= 0; i--) {
     CallFrame *frame = &vm.frames[i];
     ObjFunction *function = frame->closure->function;
 
     size_t instruction = frame->ip - function->chunk.code - 1;
-    fprintf(stderr, "[line %d] in ", function->chunk.lines[instruction]);
+    writeError("[line %d] in ", function->chunk.lines[instruction]);
 
     if (function->name == NULL) {
-      fprintf(stderr, "script\n");
+      writeError("script\n");
     } else {
-      fprintf(stderr, "%s()\n", function->name->chars);
+      writeError("%s()\n", function->name->chars);
     }
   }
 
@@ -58,7 +103,7 @@ void runtimeError(const char *format, ...) {
 }
 
 /* define a new built in function */
-static void defineNative(const char *name, NativeFn function) {
+void defineNative(const char *name, NativeFn function) {
   push(OBJ_VAL(copyString(name, (int)strlen(name))));
   push(OBJ_VAL(newNative(function)));
   tableSet(&vm.globals, AS_STRING(vm.stack[0]), vm.stack[1]);
@@ -78,6 +123,8 @@ void initVM(const char* filePath) {
 
   vm.initString = NULL;
   vm.initString = copyString("init", 4);
+  memset(vm.charStrings, 0, sizeof(vm.charStrings));
+  vm.modulesRebound = false;
 
   /* Modules */
   createAssertModule();
@@ -88,6 +135,8 @@ void initVM(const char* filePath) {
   createMathModule();
   createStringsModule();
   createArraysModule();
+  createSetsModule();
+  createStreamModule();
 
   /* System */
   defineNative("clock", clockNative);
@@ -115,11 +164,29 @@ void initVM(const char* filePath) {
   defineNative("len", lenNative);
 }
 
+/* Start from a heap image written by mt --snapshot instead of creating
+ * the modules again. Returns false if the image could not be loaded */
+bool initVMFromSnapshot(const char* filePath, const char* imagePath) {
+  resetStack();
+  vm.objects = NULL;
+  vm.fileName = filePath;
+  memset(vm.charStrings, 0, sizeof(vm.charStrings));
+
+  return loadSnapshot(imagePath);
+}
+
 void freeVM() {
   freeTable(&vm.globals);
   freeTable(&vm.strings);
   vm.initString = NULL;
   freeObjects();
+
+#ifdef MT_DEBUG_PRINT_ALLOC
+  printAllocStats();
+#endif
+
+  freePages();
+  unmapSnapshot();
 }
 
 /* wrapper for getting next value in call stack */
@@ -148,6 +215,41 @@ static bool call(ObjClosure *closure, int argCount) {
 }
 
 /* gets the value of function body to call */
+/* Call a native on the argCount values on top of the stack, which are
+ * replaced by its result. Returns false if it raised an error */
+static bool callNative(ObjNative *native, int argCount) {
+  Value *args = vm.stackTop - argCount;
+
+  /* typed natives given the numbers they expect skip the generic
+   * function and its checks */
+  if (native->numberArity == argCount) {
+    if (argCount == 1 && IS_NUMBER(args[0])) {
+      args[0] = NUMBER_VAL(native->unary(AS_NUMBER(args[0])));
+      return true;
+    }
+    if (argCount == 2 && IS_NUMBER(args[0]) && IS_NUMBER(args[1])) {
+      args[0] = NUMBER_VAL(native->binary(AS_NUMBER(args[0]),
+                                          AS_NUMBER(args[1])));
+      vm.stackTop = args + 1;
+      return true;
+    }
+  }
+
+  /* natives expect plain strings */
+  for (Value *arg = args; arg < vm.stackTop; arg++)
+    *arg = flattenValue(*arg);
+
+  Value result = native->function(argCount, args);
+
+  /* a native that raised an error has already reset the stack */
+  if (vm.frameCount == 0)
+    return false;
+
+  vm.stackTop = args;
+  push(result);
+  return true;
+}
+
 static bool callValue(Value callee, int argCount) {
   if (IS_OBJ(callee)) {
     switch (OBJ_TYPE(callee)) {
@@ -174,13 +276,14 @@ static bool callValue(Value callee, int argCount) {
       return call(AS_CLOSURE(callee), argCount);
     case OBJ_FUNCTION:
       return call(AS_CLOSURE(callee), argCount);
-    case OBJ_NATIVE: {
-      NativeFn native = AS_NATIVE(callee);
-      Value result = native(argCount, vm.stackTop - argCount);
-      vm.stackTop -= argCount + 1;
-      push(result);
+    case OBJ_NATIVE:
+      if (!callNative((ObjNative *)AS_OBJ(callee), argCount))
+        return false;
+
+      /* the result replaces the callee too */
+      vm.stackTop[-2] = vm.stackTop[-1];
+      vm.stackTop--;
       return true;
-    }
     default:
       break;
     }
@@ -218,7 +321,7 @@ static bool invoke(ObjString *name, int argCount) {
       Value function;
 
       /* Avoid treating native objects like normal objects */
-      if (!tableGet(&instance->methods, name, &function))
+      if (!tableGet(nativeClassMethods(instance), name, &function))
       {
         runtimeError("Undefined property '%s'.", name->chars);
         return false;
@@ -250,6 +353,24 @@ static bool invoke(ObjString *name, int argCount) {
   }
 }
 
+/* The slow path of a module call the compiler specialised: look the
+ * module up by name under the arguments and invoke the method on it */
+static bool invokeModule(ObjString *module, ObjString *method,
+                         int argCount) {
+  Value receiver;
+  if (!tableGet(&vm.globals, module, &receiver)) {
+    runtimeError("Undefined variable '%s'.", module->chars);
+    return false;
+  }
+
+  Value *args = vm.stackTop - argCount;
+  memmove(args + 1, args, sizeof(Value) * argCount);
+  *args = receiver;
+  vm.stackTop++;
+
+  return invoke(method, argCount);
+}
+
 /* Runtime code for bound methods of classes */
 static bool bindMethod(ObjClass *klass, ObjString *name) {
   Value method;
@@ -311,17 +432,10 @@ bool isFalsey(Value value) {
 }
 
 static void concatenate() {
-  ObjString *b = AS_STRING(pop());
-  ObjString *a = AS_STRING(pop());
+  Obj *b = AS_OBJ(pop());
+  Obj *a = AS_OBJ(pop());
 
-  int length = a->length + b->length;
-  char *chars = ALLOCATE(char, length + 1);
-  memcpy(chars, a->chars, a->length);
-  memcpy(chars + a->length, b->chars, b->length);
-  chars[length] = '\0';
-
-  ObjString *result = takeString(chars, length);
-  push(OBJ_VAL(result));
+  push(OBJ_VAL(joinStrings(a, b)));
 }
 
 /*
@@ -348,9 +462,9 @@ static ObjectModule* createModule(ObjString* relativePath)
 } 
 */
 
-/* Update an object module to actuallu import something */
-static bool importModule(const char* path) 
-{  
+/* Paths in use statements are relative to the script being run */
+static void importPath(const char* path, char* fullPath)
+{
   /* Get the index of the last '/' char */
   int lastsep = -1;
   for (int i = 0; i < strlen(vm.fileName); i++) {
@@ -358,8 +472,6 @@ static bool importModule(const char* path)
     lastsep = i; 
   }
 
-  char fullPath[4096];
-
   /* get the relative path */
   if (lastsep == -1) {
    strcpy(fullPath, path); 
@@ -368,8 +480,20 @@ static bool importModule(const char* path)
     fullPath[lastsep+1] = '\0';
     strncat(fullPath, path, strlen(path));
   }
+}
 
-  Value value;
+/* Update an object module to actuallu import something */
+static bool importModule(const char* path) 
+{  
+  char fullPath[4096];
+  importPath(path, fullPath);
+
+  if (access(fullPath, R_OK) != 0) {
+    runtimeError("Could not open '%s'.", path);
+    return false;
+  }
+
+  Value value = NIL_VAL;
   ObjString *import = copyString(fullPath, strlen(fullPath));
   char *src = readFile(fullPath);
 
@@ -398,7 +522,114 @@ static bool importModule(const char* path)
   return true;  
 }
 
-static int run() {
+/* Load a shared library of native modules once, absolute paths are
+ * passed to the loader as they are. The loader searches the system
+ * library path for a bare name, so those are made relative to here */
+static bool importNative(const char* path)
+{
+  char fullPath[4096];
+  int length;
+  if (path[0] == '/') {
+    length = snprintf(fullPath, sizeof(fullPath), "%s", path);
+  } else {
+    char scriptPath[4096];
+    importPath(path, scriptPath);
+    length = snprintf(fullPath, sizeof(fullPath), "%s%s",
+                      strchr(scriptPath, '/') == NULL ? "./" : "", scriptPath);
+  }
+
+  if (length < 0 || length >= (int)sizeof(fullPath)) {
+    runtimeError("Native module path '%s' is too long.", path);
+    return false;
+  }
+
+  Value value;
+  ObjString *library = copyString(fullPath, strlen(fullPath));
+  if (tableGet(&vm.imports, library, &value))
+    return true;
+
+  if (!loadExtension(fullPath))
+    return false;
+
+  tableSet(&vm.imports, library, BOOL_VAL(true));
+  return true;
+}
+
+/* Test the loop variable of a counted for loop against its limit */
+static inline bool forCompare(uint8_t flags, double counter, double limit) {
+  switch (flags & FOR_CMP_MASK) {
+  case FOR_CMP_LESS:
+    return counter < limit;
+  case FOR_CMP_LESS_EQUAL:
+    return !(counter > limit);
+  case FOR_CMP_GREATER:
+    return counter > limit;
+  default:
+    return !(counter < limit);
+  }
+}
+
+/* Apply op with a number to every number in a list, in place. Lists of
+ * numbers go through the Float64 kernels */
+static void broadcastList(FloatOp op) {
+  Value b = pop();
+  Value a = pop();
+  ObjList *list = IS_LIST(a) ? AS_LIST(a) : AS_LIST(b);
+  double number = IS_LIST(a) ? AS_NUMBER(b) : AS_NUMBER(a);
+
+  unshareList(list);
+  if (list->strategy == LIST_NUMBERS) {
+    floatScalarOp(op, list->numbers, list->numbers, number, false,
+                  list->count);
+  } else {
+    for (int i = 0; i < list->count; i++) {
+      if (!IS_NUMBER(list->items[i])) {
+        continue;
+      }
+      list->items[i] =
+          NUMBER_VAL(applyFloatOp(op, AS_NUMBER(list->items[i]), number));
+    }
+  }
+  push(OBJ_VAL(list));
+}
+
+/* Arithmetic with a float array on either side. Like the list broadcasts
+ * the array is updated in place, with two arrays the left one is */
+static bool floatArrayArithmetic(FloatOp op) {
+  Value b = pop();
+  Value a = pop();
+  ObjFloatArray *result;
+
+  if (IS_FLOAT_ARRAY(a) && IS_FLOAT_ARRAY(b)) {
+    ObjFloatArray *right = AS_FLOAT_ARRAY(b);
+    result = AS_FLOAT_ARRAY(a);
+    if (result->count != right->count) {
+      runtimeError("Float64 arrays must be the same length, got %d and %d.",
+                   result->count, right->count);
+      return false;
+    }
+    floatArrayOp(op, result->items, result->items, right->items,
+                 result->count);
+  } else if (IS_FLOAT_ARRAY(a) && IS_NUMBER(b)) {
+    result = AS_FLOAT_ARRAY(a);
+    floatScalarOp(op, result->items, result->items, AS_NUMBER(b), false,
+                  result->count);
+  } else if (IS_NUMBER(a) && IS_FLOAT_ARRAY(b)) {
+    result = AS_FLOAT_ARRAY(b);
+    floatScalarOp(op, result->items, result->items, AS_NUMBER(a), true,
+                  result->count);
+  } else {
+    runtimeError("Float64 arrays can only be combined with numbers or "
+                 "Float64 arrays.");
+    return false;
+  }
+
+  push(OBJ_VAL(result));
+  return true;
+}
+
+/* Run until the frame count drops back to baseFrame, 0 for a whole script */
+static int run(int baseFrame) {
   CallFrame *frame = &vm.frames[vm.frameCount - 1];
 #define READ_BYTE() (*frame->ip++)      // method to get the next byte
 #define READ_CONSTANT()                                                        \
@@ -407,6 +638,21 @@ static int run() {
   (frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 
+/* math calls compiled to their own opcode, with the argument in place of
+ * the result. Anything but a number, or math being rebound, takes the
+ * normal call */
+#define MATH_INTRINSIC(method, fn)                                             \
+  do {                                                                         \
+    if (!vm.modulesRebound && IS_NUMBER(peek(0))) {                            \
+      vm.stackTop[-1] = NUMBER_VAL(fn(AS_NUMBER(vm.stackTop[-1])));            \
+    } else {                                                                   \
+      if (!invokeModule(copyString("math", 4),                                 \
+                        copyString(method, (int)strlen(method)), 1))           \
+        return INTERPRET_RUNTIME_ERROR;                                        \
+      frame = &vm.frames[vm.frameCount - 1];                                   \
+    }                                                                          \
+  } while (false)
+
 #define BINARY_OP(valueType, op)                                               \
   do {                                                                         \
     if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {                          \
@@ -418,6 +664,25 @@ static int run() {
     push(valueType(a op b));                                                   \
   } while (false)
 
+#define FLOAT_ARRAY_OP(op)                                                     \
+  do {                                                                         \
+    if (!floatArrayArithmetic(op))                                             \
+      return INTERPRET_RUNTIME_ERROR;                                          \
+  } while (false)
+
+#define COMPARE_JUMP(condition)                                                \
+  do {                                                                         \
+    uint16_t offset = READ_SHORT();                                            \
+    if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {                          \
+      runtimeError("Operands must be numbers.");                               \
+      return INTERPRET_RUNTIME_ERROR;                                          \
+    }                                                                          \
+    double b = AS_NUMBER(pop());                                               \
+    double a = AS_NUMBER(pop());                                               \
+    if (condition)                                                             \
+      frame->ip += offset;                                                     \
+  } while (false)
+
   for (;;) {
 #ifdef MT_DEBUG_TRACE_EXEC
     printf("       ");
@@ -484,6 +749,7 @@ static int run() {
 
     case OP_DEFINE_GLOBAL: {
       ObjString *name = READ_STRING();
+      if (name->module) vm.modulesRebound = true;
       tableSet(&vm.globals, name, peek(0));
       pop();
       break;
@@ -496,6 +762,7 @@ static int run() {
       if (AS_NUMBER(peek(0)) == NUMBER_TYPE && IS_NUMBER(peek(1))) {
         pop();
         ObjString* name = READ_STRING();
+        if (name->module) vm.modulesRebound = true;
         tableSet(&vm.globals, name, peek(0));
         pop();
         break;
@@ -508,6 +775,7 @@ static int run() {
 
     case OP_SET_GLOBAL: {
       ObjString *name = READ_STRING();
+      if (name->module) vm.modulesRebound = true;
       if (tableSet(&vm.globals, name, peek(0))) {
         tableDelete(&vm.globals, name);
         runtimeError("Undefined variable '%s'.", name->chars);
@@ -586,7 +854,7 @@ static int run() {
       BINARY_OP(BOOL_VAL, <);
       break;
     case OP_ADD: {
-      if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+      if (isStringLike(peek(0)) && isStringLike(peek(1))) {
         concatenate();
       } else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
         double b = AS_NUMBER(pop());
@@ -594,17 +862,23 @@ static int run() {
         push(NUMBER_VAL(a + b));
 
       } 
+      else if (IS_FLOAT_ARRAY(peek(0)) || IS_FLOAT_ARRAY(peek(1)))
+      {
+        FLOAT_ARRAY_OP(FLOAT_ADD);
+      }
       else if (IS_TUPLE(peek(0)) && IS_TUPLE(peek(1)))  
       {
-        // Join two tuples
-        ObjTuple* b = AS_TUPLE(pop()); 
-        ObjTuple* a = AS_TUPLE(pop());
+        // Join two tuples into a new one, tuples are immutable
+        ObjTuple* b = AS_TUPLE(peek(0));
+        ObjTuple* a = AS_TUPLE(peek(1));
 
-        for (int i = 0; i < b->count; i++) {
-          appendToTuple(a, b->items[i]);
-        }
+        ObjTuple* result = newTuple(a->count + b->count);
+        memcpy(result->items, a->items, sizeof(Value) * a->count);
+        memcpy(result->items + a->count, b->items, sizeof(Value) * b->count);
 
-        push(OBJ_VAL(a));
+        pop();
+        pop();
+        push(OBJ_VAL(result));
 
       } 
       else if (IS_LIST(peek(0)) && IS_LIST(peek(1))) 
@@ -614,33 +888,14 @@ static int run() {
         ObjList* a = AS_LIST(pop());
 
         for (int i = 0;  i < b->count; i++)
-          appendToList(a, b->items[i]);
+          appendToList(a, indexFromList(b, i));
         
         push(OBJ_VAL(a));
       }
-      else if (IS_LIST(peek(0)) && IS_NUMBER(peek(1))) 
+      else if ((IS_LIST(peek(0)) && IS_NUMBER(peek(1))) ||
+               (IS_NUMBER(peek(0)) && IS_LIST(peek(1)))) 
       {
-        ObjList *list = AS_LIST(pop());
-        double b = AS_NUMBER(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) + b);
-        }
-        push(OBJ_VAL(list));
-      } else if (IS_NUMBER(peek(0)) && IS_LIST(peek(1))) {
-        double b = AS_NUMBER(pop());
-        ObjList *list = AS_LIST(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) + b);
-        }
-        push(OBJ_VAL(list));
+        broadcastList(FLOAT_ADD);
       } else {
         runtimeError("Operands must be two numbers or two strings.");
         return INTERPRET_RUNTIME_ERROR;
@@ -648,82 +903,31 @@ static int run() {
       break;
     }
     case OP_SUBTRACT:
-      if (IS_LIST(peek(0)) && IS_NUMBER(peek(1))) {
-        ObjList *list = AS_LIST(pop());
-        double b = AS_NUMBER(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) - b);
-        }
-        push(OBJ_VAL(list));
-      } else if (IS_NUMBER(peek(0)) && IS_LIST(peek(1))) {
-        double b = AS_NUMBER(pop());
-        ObjList *list = AS_LIST(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) - b);
-        }
-        push(OBJ_VAL(list));
+      if ((IS_LIST(peek(0)) && IS_NUMBER(peek(1))) ||
+          (IS_NUMBER(peek(0)) && IS_LIST(peek(1)))) {
+        broadcastList(FLOAT_SUBTRACT);
+      } else if (IS_FLOAT_ARRAY(peek(0)) || IS_FLOAT_ARRAY(peek(1))) {
+        FLOAT_ARRAY_OP(FLOAT_SUBTRACT);
       } else {
         BINARY_OP(NUMBER_VAL, -);
       }
       break;
     case OP_MULTIPLY:
-      if (IS_LIST(peek(0)) && IS_NUMBER(peek(1))) {
-        ObjList *list = AS_LIST(pop());
-        double b = AS_NUMBER(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) * b);
-        }
-        push(OBJ_VAL(list));
-      } else if (IS_NUMBER(peek(0)) && IS_LIST(peek(1))) {
-        double b = AS_NUMBER(pop());
-        ObjList *list = AS_LIST(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) * b);
-        }
-        push(OBJ_VAL(list));
+      if ((IS_LIST(peek(0)) && IS_NUMBER(peek(1))) ||
+          (IS_NUMBER(peek(0)) && IS_LIST(peek(1)))) {
+        broadcastList(FLOAT_MULTIPLY);
+      } else if (IS_FLOAT_ARRAY(peek(0)) || IS_FLOAT_ARRAY(peek(1))) {
+        FLOAT_ARRAY_OP(FLOAT_MULTIPLY);
       } else {
         BINARY_OP(NUMBER_VAL, *);
       }
       break;
     case OP_DIVIDE:
-      if (IS_LIST(peek(0)) && IS_NUMBER(peek(1))) {
-        ObjList *list = AS_LIST(pop());
-        double b = AS_NUMBER(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) / b);
-        }
-        push(OBJ_VAL(list));
-      } else if (IS_NUMBER(peek(0)) && IS_LIST(peek(1))) {
-        double b = AS_NUMBER(pop());
-        ObjList *list = AS_LIST(pop());
-
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(AS_NUMBER(list->items[i]) / b);
-        }
-        push(OBJ_VAL(list));
+      if ((IS_LIST(peek(0)) && IS_NUMBER(peek(1))) ||
+          (IS_NUMBER(peek(0)) && IS_LIST(peek(1)))) {
+        broadcastList(FLOAT_DIVIDE);
+      } else if (IS_FLOAT_ARRAY(peek(0)) || IS_FLOAT_ARRAY(peek(1))) {
+        FLOAT_ARRAY_OP(FLOAT_DIVIDE);
       } else {
         BINARY_OP(NUMBER_VAL, /);
       }
@@ -732,29 +936,39 @@ static int run() {
     case OP_NOT:
       push(BOOL_VAL(isFalsey(pop())));
       break;
-    case OP_POW: {
-      if (IS_LIST(peek(0)) && IS_NUMBER(peek(1))) {
-        ObjList *list = AS_LIST(pop());
-        double b = AS_NUMBER(pop());
+    case OP_MATH_SQRT:
+      MATH_INTRINSIC("Sqrt", sqrt);
+      break;
 
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(pow(AS_NUMBER(list->items[i]), b));
-        }
-        push(OBJ_VAL(list));
-      } else if (IS_NUMBER(peek(0)) && IS_LIST(peek(1))) {
+    case OP_MATH_ABS:
+      MATH_INTRINSIC("Abs", fabs);
+      break;
+
+    case OP_MATH_SIN:
+      MATH_INTRINSIC("Sin", sin);
+      break;
+
+    case OP_MATH_COS:
+      MATH_INTRINSIC("Cos", cos);
+      break;
+
+    case OP_MATH_POW:
+      if (!vm.modulesRebound && IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
         double b = AS_NUMBER(pop());
-        ObjList *list = AS_LIST(pop());
+        vm.stackTop[-1] = NUMBER_VAL(pow(AS_NUMBER(vm.stackTop[-1]), b));
+      } else {
+        if (!invokeModule(copyString("math", 4), copyString("Pow", 3), 2))
+          return INTERPRET_RUNTIME_ERROR;
+        frame = &vm.frames[vm.frameCount - 1];
+      }
+      break;
 
-        for (int i = 0; i < list->count; i++) {
-          if (!IS_NUMBER(list->items[i])) {
-            continue;
-          }
-          list->items[i] = NUMBER_VAL(pow(AS_NUMBER(list->items[i]), b));
-        }
-        push(OBJ_VAL(list));
+    case OP_POW: {
+      if ((IS_LIST(peek(0)) && IS_NUMBER(peek(1))) ||
+          (IS_NUMBER(peek(0)) && IS_LIST(peek(1)))) {
+        broadcastList(FLOAT_POW);
+      } else if (IS_FLOAT_ARRAY(peek(0)) || IS_FLOAT_ARRAY(peek(1))) {
+        FLOAT_ARRAY_OP(FLOAT_POW);
       } else {
         double b = AS_NUMBER(pop());
         double a = AS_NUMBER(pop());
@@ -792,23 +1006,24 @@ static int run() {
     }
     case OP_PRINT: {
       printValue(pop());
-      printf("\n");
+      writeOutput("\n");
       break;
     }
 
     case OP_USE: 
     {
+      vm.stackTop[-1] = flattenValue(peek(0));
       if (!IS_STRING(peek(0))) {
         runtimeError("Module name must be a string");
         return INTERPRET_RUNTIME_ERROR;
       }
 
       bool success = importModule(AS_CSTRING(pop()));
-      pop();
-
       if (!success) {
         return INTERPRET_COMPILE_ERROR;
       }
+
+      pop();
       frame = &vm.frames[vm.frameCount - 1];
 
       break;      
@@ -817,6 +1032,21 @@ static int run() {
     case OP_USE_ALL:
       break;
 
+    case OP_USE_NATIVE:
+    {
+      vm.stackTop[-1] = flattenValue(peek(0));
+      if (!IS_STRING(peek(0))) {
+        runtimeError("Native module path must be a string");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+
+      if (!importNative(AS_CSTRING(peek(0))))
+        return INTERPRET_RUNTIME_ERROR;
+
+      pop();
+      break;
+    }
+
     case OP_JUMP: {
       uint16_t offset = READ_SHORT();
       frame->ip += offset;
@@ -836,6 +1066,72 @@ static int run() {
       break;
     }
 
+    case OP_JUMP_IF_NOT_LESS:
+      COMPARE_JUMP(!(a < b));
+      break;
+    case OP_JUMP_IF_NOT_GREATER:
+      COMPARE_JUMP(!(a > b));
+      break;
+    case OP_JUMP_IF_LESS:
+      COMPARE_JUMP(a < b);
+      break;
+    case OP_JUMP_IF_GREATER:
+      COMPARE_JUMP(a > b);
+      break;
+
+    case OP_FOR_PREP: {
+      uint8_t slot = READ_BYTE();
+      uint8_t limit = READ_BYTE();
+      uint8_t flags = READ_BYTE();
+      uint16_t offset = READ_SHORT();
+
+      Value counter = frame->slots[slot];
+      Value bound = (flags & FOR_LIMIT_CONSTANT)
+                        ? frame->closure->function->chunk.constants.values[limit]
+                        : frame->slots[limit];
+
+      if (!IS_NUMBER(counter) || !IS_NUMBER(bound)) {
+        runtimeError("Operands must be numbers.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+
+      if (!forCompare(flags, AS_NUMBER(counter), AS_NUMBER(bound)))
+        frame->ip += offset;
+      break;
+    }
+
+    case OP_FOR_LOOP: {
+      uint8_t slot = READ_BYTE();
+      uint8_t limit = READ_BYTE();
+      uint8_t flags = READ_BYTE();
+      Value step = READ_CONSTANT();
+      uint16_t offset = READ_SHORT();
+
+      Value counter = frame->slots[slot];
+      if (!IS_NUMBER(counter)) {
+        runtimeError("Operands must be numbers.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+
+      double next = (flags & FOR_STEP_SUBTRACT)
+                        ? AS_NUMBER(counter) - AS_NUMBER(step)
+                        : AS_NUMBER(counter) + AS_NUMBER(step);
+      frame->slots[slot] = NUMBER_VAL(next);
+
+      Value bound = (flags & FOR_LIMIT_CONSTANT)
+                        ? frame->closure->function->chunk.constants.values[limit]
+                        : frame->slots[limit];
+
+      if (!IS_NUMBER(bound)) {
+        runtimeError("Operands must be numbers.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+
+      if (forCompare(flags, next, AS_NUMBER(bound)))
+        frame->ip -= offset;
+      break;
+    }
+
     case OP_CALL: {
       int argCount = READ_BYTE();
       if (!callValue(peek(argCount), argCount)) {
@@ -872,6 +1168,24 @@ static int run() {
       break;
     }
 
+    /* a module method the compiler resolved, the receiver was never
+     * pushed */
+    case OP_INVOKE_NATIVE: {
+      ObjNative *native = AS_NATIVE_OBJ(READ_CONSTANT());
+      int argCount = READ_BYTE();
+
+      if (!vm.modulesRebound) {
+        if (!callNative(native, argCount))
+          return INTERPRET_RUNTIME_ERROR;
+        break;
+      }
+
+      if (!invokeModule(native->module, native->name, argCount))
+        return INTERPRET_RUNTIME_ERROR;
+      frame = &vm.frames[vm.frameCount - 1];
+      break;
+    }
+
     case OP_SUPER_INVOKE: 
     {
       ObjString* method = READ_STRING();
@@ -903,20 +1217,34 @@ static int run() {
       break;
     }
 
-    case OP_BUILD_TUPLE: 
-    {
-      ObjTuple *tuple = newTuple();
-      uint8_t itemCount = READ_BYTE();
+    case OP_BUILD_MAP: {
+      uint8_t pairCount = READ_BYTE();
+      ObjMap *map = newMap();
 
-      push(OBJ_VAL(tuple));
-      for (int i = itemCount; i > 0; i--) {
-        appendToTuple(tuple, peek(i));
+      push(OBJ_VAL(map));
+      for (int i = pairCount * 2; i > 0; i -= 2) {
+        Value key = peek(i);
+        if (!isHashable(key)) {
+          runtimeError("Map key must be a number, string, bool, nil or tuple.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        mapSet(map, key, peek(i - 1));
       }
       pop();
 
-      while (itemCount --> 0) {
-        pop();
-      }
+      vm.stackTop -= pairCount * 2;
+      push(OBJ_VAL(map));
+      break;
+    }
+
+    case OP_BUILD_TUPLE: 
+    {
+      uint8_t itemCount = READ_BYTE();
+      ObjTuple *tuple = newTuple(itemCount);
+
+      for (int i = 0; i < itemCount; i++)
+        tuple->items[i] = flattenValue(vm.stackTop[i - itemCount]);
+      vm.stackTop -= itemCount;
 
       push(OBJ_VAL(tuple));
       break;
@@ -960,19 +1288,35 @@ static int run() {
 
     case OP_FOR_ITERATOR: 
     {
+      /* the iterator lives in a hidden local with the loop variable
+       * in the slot after it */
+      uint8_t slot = READ_BYTE();
       uint16_t offset = READ_SHORT();
 
-      ObjectIterator* iterator = AS_ITERATOR(pop());
+      ObjectIterator* iterator = AS_ITERATOR(frame->slots[slot]);
+
+      /* streams pull their next item, which may call back into mt */
+      if (iterator->stream != NULL) {
+        Value item;
+        StreamResult result = nextFromStream(iterator->stream, &item);
+
+        if (result == STREAM_ERROR)
+          return INTERPRET_RUNTIME_ERROR;
+
+        if (result == STREAM_END)
+          frame->ip += offset;
+        else
+          frame->slots[slot + 1] = item;
+        break;
+      }
 
       if (reachedEnd(iterator)) {
         frame->ip += offset;
       } 
       else 
       {
-        // this works
-        push(valueFromIterable(iterator));
+        frame->slots[slot + 1] = valueFromIterable(iterator);
         advanceIterator(iterator);
-        push(OBJ_VAL(iterator));
       }
       break;
     }
@@ -996,6 +1340,34 @@ static int run() {
           push(OBJ_VAL(iter));
           break;
         }
+        case OBJ_MAP: 
+        case OBJ_SET: 
+        {
+          /* iterate over a copy of the keys so the map can change */
+          ObjectIterator* iter = newIterator();  
+          iter->list = mapKeys(AS_MAP(obj));
+          iter->iter = 0;
+          push(OBJ_VAL(iter));
+          break;
+        }
+        case OBJ_FLOAT_ARRAY: 
+        {
+          ObjectIterator* iter = newIterator();  
+          iter->list = floatArrayToList(AS_FLOAT_ARRAY(obj));
+          iter->iter = 0;
+          push(OBJ_VAL(iter));
+          break;
+        }
+        case OBJ_STREAM: 
+        {
+          if (!claimStream(AS_STREAM(obj)))
+            return INTERPRET_RUNTIME_ERROR;
+
+          ObjectIterator* iter = newIterator();  
+          iter->stream = AS_STREAM(obj);
+          push(OBJ_VAL(iter));
+          break;
+        }
         default:
           runtimeError("Object '%s' is not iterable", AS_CSTRING(obj));
           break;
@@ -1003,9 +1375,41 @@ static int run() {
       break;
     }
 
+    case OP_IN: {
+      Value container = flattenValue(pop());
+      Value item = pop();
+      bool found = false;
+
+      if (IS_SET(container) || IS_MAP(container)) {
+        Value unused;
+        found = isHashable(item) && mapGet(AS_MAP(container), item, &unused);
+      } else if (IS_LIST(container)) {
+        ObjList *list = AS_LIST(container);
+        for (int i = 0; i < list->count && !found; i++)
+          found = valuesEqual(indexFromList(list, i), item);
+      } else if (IS_TUPLE(container)) {
+        ObjTuple *tuple = AS_TUPLE(container);
+        for (int i = 0; i < tuple->count && !found; i++)
+          found = valuesEqual(tuple->items[i], item);
+      } else if (IS_STRING(container)) {
+        item = flattenValue(item);
+        if (!IS_STRING(item)) {
+          runtimeError("Can only search for a string in a string.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        found = strstr(AS_CSTRING(container), AS_CSTRING(item)) != NULL;
+      } else {
+        runtimeError("Right operand of 'in' must be a set, map, list, tuple or string.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+
+      push(BOOL_VAL(found));
+      break;
+    }
+
     case OP_INDEX_SUBSCR: {
       Value index = pop();
-      Value indexable = pop();
+      Value indexable = flattenValue(pop());
       Value result;
 
       if (IS_LIST(indexable)) {
@@ -1019,6 +1423,15 @@ static int run() {
           return INTERPRET_RUNTIME_ERROR;
         }
         result = indexFromList(list, AS_NUMBER(index));
+      } else if (IS_MAP(indexable)) {
+        if (!isHashable(index)) {
+          runtimeError("Map key must be a number, string, bool, nil or tuple.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        // missing keys read as nil
+        if (!mapGet(AS_MAP(indexable), index, &result)) {
+          result = NIL_VAL;
+        }
       } else if (IS_STRING(indexable)) {
         ObjString *string = AS_STRING(indexable);
         if (!IS_NUMBER(index)) {
@@ -1041,6 +1454,19 @@ static int run() {
         }
         result = indexFromTuple(tuple, AS_NUMBER(index));
 
+      } else if (IS_FLOAT_ARRAY(indexable)) {
+        ObjFloatArray *array = AS_FLOAT_ARRAY(indexable);
+
+        if (!IS_NUMBER(index)) {
+          runtimeError("Float64 index must be a number.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        int i = AS_NUMBER(index);
+        if (i < 0 || i >= array->count) {
+          runtimeError("Float64 index out of range.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        result = NUMBER_VAL(array->items[i]);
       } else {
         runtimeError("Object is not indexable");
         return INTERPRET_RUNTIME_ERROR;
@@ -1055,6 +1481,32 @@ static int run() {
       Value index = pop();
       Value indexable = pop();
 
+      if (IS_MAP(indexable)) {
+        if (!isHashable(index)) {
+          runtimeError("Map key must be a number, string, bool, nil or tuple.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        mapSet(AS_MAP(indexable), index, flattenValue(item));
+        push(item);
+        break;
+      }
+
+      if (IS_FLOAT_ARRAY(indexable)) {
+        ObjFloatArray *array = AS_FLOAT_ARRAY(indexable);
+        if (!IS_NUMBER(index) || !IS_NUMBER(item)) {
+          runtimeError("Float64 index and value must be numbers.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        int i = AS_NUMBER(index);
+        if (i < 0 || i >= array->count) {
+          runtimeError("Float64 index out of range.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        array->items[i] = AS_NUMBER(item);
+        push(item);
+        break;
+      }
+
       if (!IS_LIST(indexable)) {
         runtimeError("Cannot store value in a non-list.");
         return INTERPRET_RUNTIME_ERROR;
@@ -1097,14 +1549,16 @@ static int run() {
       closeUpvalues(frame->slots);
 
       vm.frameCount--;
-      if (vm.frameCount == 0) {
-        pop();
-        return INTERPRET_OK;
-      }
-
       vm.stackTop = frame->slots;
       push(result);
 
+      if (vm.frameCount == 0)
+        return INTERPRET_OK;
+
+      /* back in the native that called vmCall */
+      if (vm.frameCount == baseFrame)
+        return INTERPRET_OK;
+
       frame = &vm.frames[vm.frameCount - 1]; 
 
       break;
@@ -1148,6 +1602,9 @@ static int run() {
 #undef READ_SHORT
 #undef READ_STRING
 #undef BINARY_OP
+#undef MATH_INTRINSIC
+#undef FLOAT_ARRAY_OP
+#undef COMPARE_JUMP
 }
 
 InterpretResult interpretModule(const char *source) 
@@ -1163,9 +1620,34 @@ InterpretResult interpretModule(const char *source)
   pop();
   push(OBJ_VAL(closure));
 
-  return run();
+  return run(0);
+}
+
+
+bool isCallable(Value value)
+{
+  return IS_CLOSURE(value) || IS_NATIVE(value) || IS_BOUND_METHOD(value) ||
+         IS_CLASS(value);
 }
 
+bool vmCall(Value callee, Value *args, int argCount, Value *result)
+{
+  int baseFrame = vm.frameCount;
+
+  push(callee);
+  for (int i = 0; i < argCount; i++)
+    push(args[i]);
+
+  if (!callValue(callee, argCount))
+    return false;
+
+  /* closures push a frame, natives and bare classes finish straight away */
+  if (vm.frameCount > baseFrame && run(baseFrame) != INTERPRET_OK)
+    return false;
+
+  *result = pop();
+  return true;
+}
 
 // Main Interpret function, creates a main object
 InterpretResult interpret(const char *source) 
@@ -1181,7 +1663,10 @@ InterpretResult interpret(const char *source)
   push(OBJ_VAL(closure));
   callValue(OBJ_VAL(closure), 0);
 
-  return run();
+  InterpretResult result = run(0);
+  if (result == INTERPRET_OK)
+    pop();
+  return result;
 }
 
 void push(Value value) {
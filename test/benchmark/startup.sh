@@ -0,0 +1,10 @@
+#!/bin/bash
+
+# Time how long mt takes to start and exit with nothing to run, which is
+# most of the cost of a short script. Usage: startup.sh [runs] [mt binary]
+
+RUNS=${1:-500}
+MT=${2:-mt}
+
+echo "----------------- mt startup ($RUNS runs) -----------------"
+time (for i in $(seq $RUNS); do $MT -e ''; done)
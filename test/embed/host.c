@@ -0,0 +1,103 @@
+/* A host program using libmt, prints nothing if everything works */
+#include <stdio.h>
+#include <string.h>
+
+#include "../../include/mt.h"
+
+static char output[4096];
+static char errors[4096];
+static int failures = 0;
+
+static void collectOutput(const char* text, size_t length, void* data)
+{
+  strncat(output, text, length);
+}
+
+static void collectErrors(const char* text, size_t length, void* data)
+{
+  strncat(errors, text, length);
+}
+
+static void check(bool ok, const char* what)
+{
+  if (!ok)
+  {
+    printf("failed: %s\n", what);
+    failures++;
+  }
+}
+
+/* host native, scale(x) multiplies by 10 */
+static MtValue scaleNative(int argCount, MtValue* args)
+{
+  if (argCount != 1 || !mtIsNumber(args[0]))
+  {
+    mtError("scale() takes a number.");
+    return mtNil();
+  }
+  return mtNumber(mtAsNumber(args[0]) * 10);
+}
+
+int main()
+{
+  MtConfig config = { collectOutput, collectErrors, NULL };
+  MtVM* vm = mtNewVM(&config);
+  check(vm != NULL, "mtNewVM");
+  check(mtNewVM(NULL) == NULL, "one vm at a time");
+
+  mtDefineNative(vm, "scale", scaleNative);
+  mtSetGlobal(vm, "base", mtNumber(1));
+  mtSetGlobal(vm, "runs", mtNumber(0));
+
+  MtScript* script = mtCompile(vm,
+
+    "fn add(a, b) { return a + b + base; }\n"
+    "fn greet(name) { return \"hi \" + name; }\n"
+    "fn fail() { return scale(\"x\"); }\n"
+    "runs = runs + 1;\n"
+    "print scale(runs);\n", "host");
+  check(script != NULL, "mtCompile");
+
+  /* compile once, run twice */
+  check(mtRun(vm, script) == MT_OK, "first run");
+  check(mtRun(vm, script) == MT_OK, "second run");
+  check(strcmp(output, "10\n20\n") == 0, "print goes to the output callback");
+
+  mtPush(vm, mtNumber(2));
+  mtPush(vm, mtNumber(3));
+  check(mtCall(vm, "add", 2) == MT_OK, "mtCall");
+  check(mtAsNumber(mtPop(vm)) == 6, "add result");
+
+  mtPush(vm, mtString(vm, "there", 5));
+  check(mtCall(vm, "greet", 1) == MT_OK, "mtCall with a string");
+  int length;
+  const char* greeting = mtAsString(mtPop(vm), &length);
+  check(greeting != NULL && length == 8 && strcmp(greeting, "hi there") == 0,
+        "string result");
+
+  /* errors go to the error callback and the vm keeps working */
+  check(mtCall(vm, "fail", 0) == MT_RUNTIME_ERROR, "runtime error");
+  check(strstr(errors, "scale() takes a number.") != NULL, "runtime error text");
+  check(mtCall(vm, "missing", 0) == MT_RUNTIME_ERROR, "missing function");
+  check(mtCompile(vm, "var = ;", "broken") == NULL, "compile error");
+  check(strstr(errors, "broken") != NULL, "compile error text");
+
+  MtValue runs;
+  check(mtGetGlobal(vm, "runs", &runs) && mtAsNumber(runs) == 2, "globals");
+
+  mtPush(vm, mtNumber(4));
+  mtPush(vm, mtNumber(5));
+  check(mtCall(vm, "add", 2) == MT_OK && mtAsNumber(mtPop(vm)) == 10,
+        "calls after an error");
+
+  mtFreeVM(vm);
+
+  /* a fresh vm after the first one is gone */
+  vm = mtNewVM(NULL);
+  check(vm != NULL, "second vm");
+  MtValue missing;
+  check(!mtGetGlobal(vm, "add", &missing), "second vm starts empty");
+  mtFreeVM(vm);
+
+  return failures != 0;
+}
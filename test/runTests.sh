@@ -44,6 +44,32 @@ else
   testPass "defer" 1
 fi
 
+# embed, a host program linked with the libmt.a make builds
+HOST=$(mktemp)
+if [[ $(cc -std=c99 -o $HOST embed/host.c ../libmt.a -lm -lpthread -ldl 2>&1 && $HOST) ]]; then
+  testFail "embed"
+else
+  testPass "embed" 1
+fi
+rm -f $HOST
+
+# extension, local.mt runs from a directory it shares with the library
+LOCAL=$(mktemp -d)
+cp ../example/extension/libvector.so extension/local.mt $LOCAL
+if [[ $(mt extension/extension.mt) || $(cd $LOCAL && mt local.mt 2>&1) ]]; then
+  testFail "extension"
+else
+  testPass "extension" 2
+fi
+rm -rf $LOCAL
+
+# float64
+if [[ $(mt float64/float64.mt) ]]; then
+  testFail "float64"
+else
+  testPass "float64" 1
+fi
+
 # lambda
 if [[ $(mt lambda/lambda.mt) ]]; then
   testFail "lambda"
@@ -51,6 +77,41 @@ else
   testPass "lambda" 1
 fi
 
+# list
+if [[ $(mt list/list.mt) || $(mt list/view.mt) || $(mt list/deque.mt) || $(mt list/functional.mt) ]]; then
+  testFail "list"
+else
+  testPass "list" 4
+fi
+
+# loop
+if [[ $(mt loop/loop.mt) ]]; then
+  testFail "loop"
+else
+  testPass "loop" 1
+fi
+
+# math
+if [[ $(mt math/math.mt) ]]; then
+  testFail "math"
+else
+  testPass "math" 1
+fi
+
+# map
+if [[ $(mt map/map.mt) ]]; then
+  testFail "map"
+else
+  testPass "map" 1
+fi
+
+# module
+if [[ $(mt module/module.mt) ]]; then
+  testFail "module"
+else
+  testPass "module" 1
+fi
+
 # return
 if [[ $(mt return/return.mt) ]]; then
  testFail "return"
@@ -58,6 +119,46 @@ else
  testPass "return" 1
 fi 
 
+# set
+if [[ $(mt set/set.mt) ]]; then
+ testFail "set"
+else
+ testPass "set" 1
+fi 
+
+# snapshot, the script runs on the heap the prelude left behind
+IMAGE=$(mktemp)
+if [[ $(mt --snapshot $IMAGE snapshot/prelude.mt 2>&1 && mt --from-snapshot $IMAGE snapshot/snapshot.mt 2>&1) ]]; then
+  testFail "snapshot"
+else
+  testPass "snapshot" 1
+fi
+rm -f $IMAGE
+
+# sort
+if [[ $(mt sort/sort.mt) ]]; then
+ testFail "sort"
+else
+ testPass "sort" 1
+fi 
+
+# stream
+if [[ $(mt stream/stream.mt) ]]; then
+ testFail "stream"
+else
+ testPass "stream" 1
+fi
+
+# string, collisions.c checks hash quality against the libmt.a make builds
+COLLISIONS=$(mktemp)
+if [[ $(mt string/concat.mt) || $(mt string/hash.mt) || $(mt string/slice.mt) ||
+      $(cc -std=c99 -o $COLLISIONS string/collisions.c ../libmt.a -lm -lpthread -ldl 2>&1 && $COLLISIONS) ]]; then
+ testFail "string"
+else
+ testPass "string" 4
+fi 
+rm -f $COLLISIONS
+
 # switch
 if [[ $(mt switch/switch.mt) ]]; then
  testFail "switch"
@@ -65,6 +166,14 @@ else
  testPass "switch" 1
 fi 
 
+# table, churns keys through a table built against the libmt.a make builds
+CHURN=$(mktemp)
+if [[ $(cc -std=c99 -o $CHURN table/churn.c ../libmt.a -lm -lpthread -ldl 2>&1 && $CHURN) ]]; then
+  testFail "table"
+else
+  testPass "table" 1
+fi
+rm -f $CHURN
 
 # use 
 if [[ $(mt use/use.mt) ]]; then
@@ -0,0 +1,123 @@
+/* Families of similar keys must hash like a random function, and every
+ * key must be found again in a table. Prints nothing if they do */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/mt.h"
+#include "../../include/object.h"
+#include "../../include/table.h"
+
+#define KEYS 20000
+#define SLOTS 32768
+
+/* Shared parts on both sides of the 16, 32 and 64 byte paths */
+static const int padLengths[] = { 0, 7, 8, 9, 15, 16, 17, 31, 32, 33,
+                                  63, 64, 65, 100 };
+
+static ObjString* keys[KEYS];
+static uint32_t hashes[KEYS];
+static int failures = 0;
+
+static void check(bool ok, const char* what, const char* family)
+{
+  if (!ok)
+  {
+    printf("failed: %s for %s\n", what, family);
+    failures++;
+  }
+}
+
+static int compareHashes(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+/* Build the family, key i is pad + i when prefix is set, else i + pad */
+static void makeKeys(int padLength, bool prefix)
+{
+  char pad[128];
+  memset(pad, 'x', padLength);
+  pad[padLength] = '\0';
+
+  for (int i = 0; i < KEYS; i++)
+  {
+    char name[160];
+    int length = prefix ? snprintf(name, sizeof(name), "%s%d", pad, i)
+                        : snprintf(name, sizeof(name), "%d%s", i, pad);
+    keys[i] = internedString(copyString(name, length));
+    hashes[i] = keys[i]->hash;
+  }
+}
+
+static void checkFamily(const char* family)
+{
+  // every key goes back to its own value
+  Table table;
+  initTable(&table);
+  for (int i = 0; i < KEYS; i++) tableSet(&table, keys[i], NUMBER_VAL(i));
+
+  bool found = true;
+  for (int i = 0; i < KEYS && found; i++)
+  {
+    Value value;
+    found = tableGet(&table, keys[i], &value) && AS_NUMBER(value) == i;
+  }
+  check(found, "lookup", family);
+  freeTable(&table);
+
+  // the table picks slots with the high bits, a random function puts
+  // KEYS - SLOTS * (1 - (1 - 1/SLOTS)^KEYS) keys in an occupied slot
+  static bool used[SLOTS];
+  memset(used, 0, sizeof(used));
+  int collisions = 0;
+  for (int i = 0; i < KEYS; i++)
+  {
+    int slot = HASH_SLOT(hashes[i]) & (SLOTS - 1);
+    if (used[slot]) collisions++;
+    used[slot] = true;
+  }
+  double expected = KEYS - SLOTS * (1 - pow(1 - 1.0 / SLOTS, KEYS));
+  check(collisions < expected * 1.1, "slot collisions", family);
+
+  // and filters on the low 7 bits, each of which should be as common
+  int controls[128] = { 0 };
+  for (int i = 0; i < KEYS; i++) controls[HASH_CONTROL(hashes[i])]++;
+  for (int i = 0; i < 128; i++)
+  {
+    if (controls[i] < KEYS / 128 / 2 || controls[i] > KEYS / 128 * 3 / 2)
+    {
+      check(false, "control byte spread", family);
+      break;
+    }
+  }
+
+  // a full 32 bit collision is unlikely for this many keys
+  qsort(hashes, KEYS, sizeof(uint32_t), compareHashes);
+  int duplicates = 0;
+  for (int i = 1; i < KEYS; i++) duplicates += hashes[i] == hashes[i - 1];
+  check(duplicates <= 2, "full hash collisions", family);
+}
+
+int main(void)
+{
+  MtVM* vm = mtNewVM(NULL);
+
+  for (size_t i = 0; i < sizeof(padLengths) / sizeof(padLengths[0]); i++)
+  {
+    char family[64];
+
+    makeKeys(padLengths[i], true);
+    snprintf(family, sizeof(family), "%d byte prefix", padLengths[i]);
+    checkFamily(family);
+
+    makeKeys(padLengths[i], false);
+    snprintf(family, sizeof(family), "%d byte suffix", padLengths[i]);
+    checkFamily(family);
+  }
+
+  mtFreeVM(vm);
+  return failures > 0;
+}
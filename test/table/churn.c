@@ -0,0 +1,161 @@
+/* 10M keys churned through a table with inserts and deletes, its size,
+ * memory and probes must stay bounded. Prints nothing if they do */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../include/memory.h"
+#include "../../include/mt.h"
+#include "../../include/object.h"
+#include "../../include/table.h"
+
+#define WINDOW 1000
+#define ROUNDS 10000000
+
+/* Rounds after which the table should have reached its final size */
+#define SETTLED 100000
+
+/* Most groups a lookup has to visit before it reaches the key */
+#define MAX_PROBE 4
+
+/* The live keys, key i is in window[i % WINDOW] */
+static ObjString* window[WINDOW];
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+  if (!ok)
+  {
+    printf("failed: %s\n", what);
+    failures++;
+  }
+}
+
+/* Keys are made here rather than with copyString, so the 10M of them do
+ * not pile up in the vm's intern table. The hash only has to be well
+ * mixed, string/collisions.c checks the real one */
+static ObjString* newKey(uint32_t i)
+{
+  ObjString* key = malloc(sizeof(ObjString) + 16);
+  key->obj.type = OBJ_STRING;
+  key->obj.next = NULL;
+  key->length = snprintf(key->chars, 16, "key%u", i);
+  key->interned = true;
+  key->module = false;
+
+  uint64_t x = i + 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  key->hash = (uint32_t)(x ^ (x >> 31));
+  return key;
+}
+
+/* Groups visited to find key, the way the table searches for it */
+static int probeLength(Table* table, ObjString* key)
+{
+  int visited = 0;
+  FOR_EACH_GROUP(table->capacity, key->hash, group)
+  {
+    visited++;
+    for (int i = 0; i < TABLE_GROUP_SIZE; i++)
+    {
+      if (table->entries[group * TABLE_GROUP_SIZE + i].key == key)
+        return visited;
+    }
+    if (visited > table->capacity) return visited;
+  }
+}
+
+static int longestProbe(Table* table)
+{
+  int longest = 0;
+  for (int i = 0; i < WINDOW; i++)
+  {
+    int length = probeLength(table, window[i]);
+    if (length > longest) longest = length;
+  }
+  return longest;
+}
+
+int main(void)
+{
+  MtVM* vm = mtNewVM(NULL);
+  size_t before = allocStats.bytesAllocated;
+
+  Table table;
+  initTable(&table);
+  for (int i = 0; i < WINDOW; i++)
+  {
+    window[i] = newKey(i);
+    tableSet(&table, window[i], NUMBER_VAL(i));
+  }
+
+  int capacity = table.capacity;
+  int biggest = capacity;
+  int longest = longestProbe(&table);
+  size_t bytes = allocStats.bytesAllocated - before;
+  size_t mostBytes = bytes;
+  int settled = capacity;
+  size_t settledBytes = bytes;
+
+  // slide the window along, one delete and one insert each round
+  for (int i = WINDOW; i < ROUNDS; i++)
+  {
+    ObjString** slot = &window[i % WINDOW];
+    check(tableDelete(&table, *slot), "delete a live key");
+    free(*slot);
+
+    *slot = newKey(i);
+    check(tableSet(&table, *slot, NUMBER_VAL(i)), "insert a new key");
+    if (table.capacity > biggest) biggest = table.capacity;
+    if (allocStats.bytesAllocated - before > mostBytes)
+      mostBytes = allocStats.bytesAllocated - before;
+
+    if (i == SETTLED)
+    {
+      settled = table.capacity;
+      settledBytes = allocStats.bytesAllocated - before;
+    }
+
+    if (i % 1000000 == 0)
+    {
+      int probe = longestProbe(&table);
+      if (probe > longest) longest = probe;
+    }
+  }
+
+  // tombstones may push it up one size before rehashing in place keeps
+  // it there, after that nothing grows
+  check(biggest <= GROW_CAPACITY(capacity + 1) - 1, "table size is bounded");
+  check(mostBytes <= 2 * bytes, "table memory is bounded");
+  check(table.capacity == settled, "table does not grow once settled");
+  check(allocStats.bytesAllocated - before == settledBytes,
+        "table memory does not grow once settled");
+  check(longest <= MAX_PROBE, "probes stay short under churn");
+  check(table.tombstones * 2 <= table.count, "tombstones are cleared");
+
+  Value value;
+  bool kept = true;
+  for (int i = 0; i < WINDOW; i++)
+  {
+    kept = kept && tableGet(&table, window[i], &value) &&
+           (int)AS_NUMBER(value) % WINDOW == i;
+  }
+  check(kept, "live keys keep their values");
+
+  // shrinks as keys are deleted and frees its storage once empty
+  for (int i = 0; i < WINDOW - 10; i++) tableDelete(&table, window[i]);
+  check(table.capacity < capacity, "table shrinks once mostly empty");
+
+  for (int i = WINDOW - 10; i < WINDOW; i++) tableDelete(&table, window[i]);
+  check(table.entries == NULL && table.count == 0, "empty table frees storage");
+  check(allocStats.bytesAllocated == before, "empty table holds no memory");
+
+  for (int i = 0; i < WINDOW; i++) free(window[i]);
+  mtFreeVM(vm);
+
+  if (failures > 0)
+    printf("%d churn check(s) failed, longest probe %d, capacity %d -> %d, "
+           "%zu -> %zu bytes\n", failures, longest, capacity + 1,
+           biggest + 1, bytes, mostBytes);
+  return failures > 0;
+}